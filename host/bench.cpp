@@ -0,0 +1,213 @@
+/*
+    GPIO-operation microbenchmarks of the mapper routines against the MBC models.
+
+    For every mapper and operation the GPIO writes, GPIO reads and the modelled bus time are
+    reported per transferred byte. The model is deterministic, so the numbers only change when
+    the code does. They are compared against bench_baseline.txt which is updated (make bench-baseline)
+    and committed together with every change that moves them, so the history of that file is the
+    per-commit record and every regression fails make bench.
+
+        bench                       prints the numbers
+        bench --baseline FILE       compares them with FILE, fails on a regression
+        bench --write FILE [COMMIT] writes them to FILE as the new baseline
+*/
+#include "cartridges.h"
+#include "host_io.h"
+#include "pmod_board.h"
+
+#include "cartridge.h"
+#include "bus.h"
+#include "timing.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Anything more than this above the baseline is a regression, the model itself does not jitter.
+const double REGRESSION_TOLERANCE = 0.005;
+
+const unsigned NUM_METRICS = 3;
+const char* const METRIC_NAMES[NUM_METRICS] = { "writes/byte", "reads/byte", "ns/byte" };
+
+struct BenchResult
+{
+    std::string name;
+    double metrics[NUM_METRICS];
+};
+
+static std::vector<BenchResult> results;
+
+// Runs operation once and records what it cost per byte.
+template <typename Operation>
+static void measure(const PmodBoard& board, const char* mapper, const char* operation_name, unsigned bytes, Operation&& operation)
+{
+    PmodBoardCounters before = board.get_counters();
+    uint64_t start = host::get_ticks();
+
+    operation();
+
+    PmodBoardCounters after = board.get_counters();
+    uint64_t duration = host::get_ticks() - start;
+
+    results.push_back({
+        std::string(mapper) + "." + operation_name,
+        {
+            double(after.gpio_writes - before.gpio_writes) / bytes,
+            double(after.gpio_reads - before.gpio_reads) / bytes,
+            host::ticks_to_ns(duration) / bytes
+        }
+    });
+}
+
+/*
+    Every transfer is measured after a first one of the same kind, so it contains
+    a bank switch like the banks of a dump do but not the reset at the start of a command.
+*/
+template <typename Mapper>
+static void bench_rom(const PmodBoard& board, const char* mapper)
+{
+    Mapper::reset();
+    read_rom<Mapper>(1);
+
+    measure(board, mapper, "rom_bank", ROM_BANK_SIZE, [] { read_rom<Mapper>(2); });
+}
+
+template <typename Mapper>
+static void bench_ram(const PmodBoard& board, const char* mapper, unsigned num_banks)
+{
+    const uint8_t bank = num_banks > 1 ? 1 : 0;
+
+    Mapper::reset();
+    read_ram<Mapper>(0);
+
+    measure(board, mapper, "ram_bank", Mapper::RAM_BANK_SIZE, [&] { read_ram<Mapper>(bank); });
+
+    for (unsigned i = 0; i < Mapper::RAM_BANK_SIZE; ++i)
+        cartridge_buffer[i] = rand();
+
+    measure(board, mapper, "ram_write", Mapper::RAM_BANK_SIZE, [&] { write_ram<Mapper>(bank); });
+
+    // Writing back what is already there, which the delta mode reduces to a read.
+    measure(board, mapper, "ram_delta", Mapper::RAM_BANK_SIZE, [&] { write_ram_delta<Mapper>(bank); });
+}
+
+static void bench_cartridge(const CartridgeConfig& config)
+{
+    MbcCartridge cartridge(config.type, config.cartridge_type, config.rom_banks, config.ram_size);
+    PmodBoard board(cartridge);
+
+    host::attach_board(&board);
+    bus_init();
+
+    uint8_t cartridge_type = 0;
+
+    measure(board, config.name, "header", sizeof(cartridge_header), [&] {
+        cartridge_type = mbc1::read_header()->cartridge_type;
+    });
+
+    select_timing_profile((cartridge_header*)&cartridge.rom[HEADER_BASE_ADDRESS]);
+
+    dispatch_rom_mapper(cartridge_type, [&](auto mapper) {
+        bench_rom<decltype(mapper)>(board, config.name);
+    });
+
+    dispatch_ram_mapper(cartridge_type, [&](auto mapper) {
+        bench_ram<decltype(mapper)>(board, config.name, cartridge.ram.size() / decltype(mapper)::RAM_BANK_SIZE);
+    });
+
+    host::attach_board(nullptr);
+}
+
+static void print_results(FILE* file)
+{
+    fprintf(file, "# %-18s", "operation");
+    for (const char* metric : METRIC_NAMES)
+        fprintf(file, " %12s", metric);
+    fprintf(file, "\n");
+
+    for (const BenchResult& result : results)
+    {
+        fprintf(file, "%-20s", result.name.c_str());
+        for (double metric : result.metrics)
+            fprintf(file, " %12.2f", metric);
+        fprintf(file, "\n");
+    }
+}
+
+// Returns false if any number got worse than the baseline allows.
+static bool compare_results(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        printf("cannot open baseline %s\n", path);
+        return false;
+    }
+
+    bool passed = true;
+    char line[256];
+
+    printf("%-20s %-12s %12s %12s %8s\n", "operation", "metric", "baseline", "current", "change");
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#') continue;
+
+        char name[64];
+        double baseline[NUM_METRICS];
+        if (sscanf(line, "%63s %lf %lf %lf", name, &baseline[0], &baseline[1], &baseline[2]) != 1 + NUM_METRICS)
+            continue;
+
+        const BenchResult* current = nullptr;
+        for (const BenchResult& result : results)
+            if (result.name == name) current = &result;
+
+        if (!current)
+        {
+            printf("%-20s missing\n", name);
+            passed = false;
+            continue;
+        }
+
+        for (unsigned metric = 0; metric < NUM_METRICS; ++metric)
+        {
+            double change = baseline[metric] != 0 ? current->metrics[metric] / baseline[metric] - 1 : 0;
+            // The baseline file is rounded to two decimals.
+            bool regressed = current->metrics[metric] > baseline[metric] * (1 + REGRESSION_TOLERANCE) + 0.005;
+
+            printf("%-20s %-12s %12.2f %12.2f %+7.1f%%%s\n", name, METRIC_NAMES[metric],
+                baseline[metric], current->metrics[metric], change * 100, regressed ? "  REGRESSION" : "");
+
+            if (regressed) passed = false;
+        }
+    }
+
+    fclose(file);
+    return passed;
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+
+    for (const CartridgeConfig& config : CARTRIDGE_CONFIGS)
+        bench_cartridge(config);
+
+    if (argc >= 3 && !strcmp(argv[1], "--baseline"))
+        return compare_results(argv[2]) ? 0 : 1;
+
+    if (argc >= 3 && !strcmp(argv[1], "--write"))
+    {
+        FILE* file = fopen(argv[2], "w");
+        if (!file) return 1;
+
+        fprintf(file, "# Generated by make bench-baseline on top of commit %s\n", argc >= 4 ? argv[3] : "unknown");
+        print_results(file);
+        fclose(file);
+    }
+
+    print_results(stdout);
+    return 0;
+}
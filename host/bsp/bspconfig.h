@@ -0,0 +1,3 @@
+#pragma once
+
+// Nothing of the BSP configuration is needed on the host.
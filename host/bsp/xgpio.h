@@ -0,0 +1,19 @@
+#pragma once
+
+#include "xil_types.h"
+#include "xstatus.h"
+#include "xparameters.h"
+
+#define XGPIO_DATA_OFFSET 0x0
+#define XGPIO_TRI_OFFSET 0x4
+
+struct XGpio
+{
+    UINTPTR BaseAddress;
+    u32 IsReady;
+};
+
+int XGpio_Initialize(XGpio* InstancePtr, UINTPTR BaseAddress);
+void XGpio_SetDataDirection(XGpio* InstancePtr, unsigned Channel, u32 DirectionMask);
+void XGpio_DiscreteWrite(XGpio* InstancePtr, unsigned Channel, u32 Mask);
+u32 XGpio_DiscreteRead(XGpio* InstancePtr, unsigned Channel);
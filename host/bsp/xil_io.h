@@ -0,0 +1,17 @@
+#pragma once
+
+#include "xil_types.h"
+
+// Every register access of the firmware ends up in the host model (see host_io.cpp).
+u32 host_in32(UINTPTR address);
+void host_out32(UINTPTR address, u32 value);
+
+inline u32 Xil_In32(UINTPTR address)
+{
+    return host_in32(address);
+}
+
+inline void Xil_Out32(UINTPTR address, u32 value)
+{
+    host_out32(address, value);
+}
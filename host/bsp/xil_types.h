@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int32_t s32;
+typedef int64_t s64;
+typedef char char8;
+typedef uintptr_t UINTPTR;
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "xil_types.h"
+
+#define XINTERRUPT_DEFAULT_PRIORITY 0xA0U
+
+int XSetupInterruptSystem(void* DriverInstance, void* IntrHandler, u32 IntrId, UINTPTR DistributorBaseAddr, u16 Priority);
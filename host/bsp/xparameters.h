@@ -0,0 +1,13 @@
+#pragma once
+
+// Addresses and clocks of the PYNQ-Z2 design, the host model decodes the same addresses.
+#define XPAR_AXI_PMOD_GPIO_BASEADDR 0x41200000
+#define STDOUT_BASEADDRESS 0xE0000000
+
+#define XPAR_XUARTPS_0_BASEADDR 0xE0000000
+#define XPAR_XUARTPS_0_CLOCK_FREQ 100000000
+#define XPAR_XUARTPS_0_INTERRUPTS 0x403b
+#define XPAR_XUARTPS_0_INTERRUPT_PARENT 0xf8f01000
+#define XPAR_XUARTLITE_0_BAUDRATE 115200
+
+#define XPAR_CPU_CORE_CLOCK_FREQ_HZ 100000000
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "xil_types.h"
+
+#define XST_SUCCESS 0L
+#define XST_FAILURE 1L
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "xil_types.h"
+
+#define GLOBAL_TMR_BASEADDR 0xF8F00200U
+#define GTIMER_COUNTER_LOWER_OFFSET 0x00U
+#define COUNTS_PER_SECOND 325000000U
+
+typedef u64 XTime;
+
+void XTime_GetTime(XTime* Xtime_Global);
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "xil_types.h"
+#include "xil_io.h"
+#include "xstatus.h"
+#include "xparameters.h"
+
+// Only the registers and bits the firmware touches, with the values of the PS UART.
+#define XUARTPS_CR_OFFSET 0x00
+#define XUARTPS_IER_OFFSET 0x08
+#define XUARTPS_IDR_OFFSET 0x0C
+#define XUARTPS_IMR_OFFSET 0x10
+#define XUARTPS_ISR_OFFSET 0x14
+#define XUARTPS_BAUDGEN_OFFSET 0x18
+#define XUARTPS_RXTOUT_OFFSET 0x1C
+#define XUARTPS_RXWM_OFFSET 0x20
+#define XUARTPS_SR_OFFSET 0x2C
+#define XUARTPS_FIFO_OFFSET 0x30
+#define XUARTPS_BAUDDIV_OFFSET 0x34
+
+#define XUARTPS_CR_STOPBRK 0x100
+#define XUARTPS_CR_TX_DIS 0x20
+#define XUARTPS_CR_TX_EN 0x10
+#define XUARTPS_CR_RX_DIS 0x08
+#define XUARTPS_CR_RX_EN 0x04
+#define XUARTPS_CR_TXRST 0x02
+#define XUARTPS_CR_RXRST 0x01
+
+#define XUARTPS_IXR_MASK 0x3FFF
+#define XUARTPS_IXR_TOUT 0x100
+#define XUARTPS_IXR_TXEMPTY 0x8
+#define XUARTPS_IXR_RXOVR 0x1
+
+#define XUARTPS_SR_TACTIVE 0x800
+#define XUARTPS_SR_TXFULL 0x10
+#define XUARTPS_SR_TXEMPTY 0x8
+#define XUARTPS_SR_RXEMPTY 0x2
+
+#define XUartPs_ReadReg(BaseAddress, RegOffset) Xil_In32((BaseAddress) + (u32)(RegOffset))
+#define XUartPs_WriteReg(BaseAddress, RegOffset, RegisterValue) Xil_Out32((BaseAddress) + (u32)(RegOffset), (u32)(RegisterValue))
+
+#define XUartPs_IsReceiveData(BaseAddress) \
+    !((XUartPs_ReadReg((BaseAddress), XUARTPS_SR_OFFSET) & (u32)XUARTPS_SR_RXEMPTY) == (u32)XUARTPS_SR_RXEMPTY)
+
+#define XUartPs_IsTransmitFull(BaseAddress) \
+    ((XUartPs_ReadReg((BaseAddress), XUARTPS_SR_OFFSET) & (u32)XUARTPS_SR_TXFULL) == (u32)XUARTPS_SR_TXFULL)
+
+void XUartPs_SendByte(UINTPTR BaseAddress, u8 Data);
+u8 XUartPs_RecvByte(UINTPTR BaseAddress);
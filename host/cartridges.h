@@ -0,0 +1,27 @@
+#pragma once
+
+#include "mbc_cartridge.h"
+
+#include "cartridge.h"
+
+/*
+    The cartridges the host tests and benchmarks run against. The access time is what each
+    timing profile is supposed to cover (see timing.cpp), reads and writes faster than that
+    are counted as timing violations by the board model.
+*/
+struct CartridgeConfig
+{
+    const char* name;
+    MbcType type;
+    uint8_t cartridge_type;
+    unsigned rom_banks;
+    unsigned ram_size;
+    uint32_t access_ns;
+};
+
+const CartridgeConfig CARTRIDGE_CONFIGS[] = {
+    { "mbc1", MbcType::MBC1, cartridge_type::MBC1_RAM_BATTERY, 128, 0x8000, 200 },
+    { "mbc2", MbcType::MBC2, cartridge_type::MBC2_BATTERY, 16, INTERNAL_RAM_SIZE, 200 },
+    { "mbc3", MbcType::MBC3, cartridge_type::MBC3_RAM_BATTERY, 128, 0x8000, 150 },
+    { "mbc5", MbcType::MBC5, cartridge_type::MBC5_RAM_BATTERY, 512, 0x20000, 100 },
+};
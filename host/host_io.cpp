@@ -0,0 +1,191 @@
+#include "host_io.h"
+
+#include "pmod_board.h"
+
+#include <deque>
+
+#include <xgpio.h>
+#include <xil_io.h>
+#include <xinterrupt_wrap.h>
+#include <xparameters.h>
+#include <xtime_l.h>
+#include <xuartps.h>
+
+static uint64_t ticks = 0;
+static PmodBoard* board = nullptr;
+
+static uint64_t uart_byte_ticks = 0;
+static uint64_t uart_drained = 0;
+static uint32_t uart_tx_fifo = 0;
+static std::vector<uint8_t> uart_tx;
+static std::deque<uint8_t> uart_rx;
+
+uint64_t host::get_ticks()
+{
+    return ticks;
+}
+
+double host::ticks_to_ns(uint64_t duration)
+{
+    return duration * 1e9 / COUNTS_PER_SECOND;
+}
+
+void host::attach_board(PmodBoard* attached)
+{
+    board = attached;
+}
+
+void host::set_uart_byte_ticks(uint64_t byte_ticks)
+{
+    uart_byte_ticks = byte_ticks;
+}
+
+// 8N1, every byte takes ten bit periods.
+void host::set_uart_baud_rate(uint32_t baud_rate)
+{
+    uart_byte_ticks = 10ull * COUNTS_PER_SECOND / baud_rate;
+}
+
+std::vector<uint8_t>& host::uart_transmitted()
+{
+    return uart_tx;
+}
+
+void host::uart_receive(const uint8_t* data, size_t length)
+{
+    uart_rx.insert(uart_rx.end(), data, data + length);
+}
+
+// Takes out of the TX FIFO what the UART sent since the last access.
+static void _drain_uart()
+{
+    if (uart_byte_ticks == 0)
+    {
+        uart_tx_fifo = 0;
+        uart_drained = ticks;
+        return;
+    }
+
+    while (uart_tx_fifo != 0 && ticks - uart_drained >= uart_byte_ticks)
+    {
+        uart_tx_fifo--;
+        uart_drained += uart_byte_ticks;
+    }
+
+    if (uart_tx_fifo == 0)
+        uart_drained = ticks;
+}
+
+static u32 _uart_in32(u32 offset)
+{
+    _drain_uart();
+
+    switch (offset)
+    {
+        case XUARTPS_SR_OFFSET:
+        {
+            u32 status = 0;
+            if (uart_rx.empty()) status |= XUARTPS_SR_RXEMPTY;
+            if (uart_tx_fifo == 0) status |= XUARTPS_SR_TXEMPTY;
+            if (uart_tx_fifo >= host::UART_FIFO_SIZE) status |= XUARTPS_SR_TXFULL;
+            return status;
+        }
+
+        case XUARTPS_FIFO_OFFSET:
+        {
+            if (uart_rx.empty()) return 0;
+
+            u8 data = uart_rx.front();
+            uart_rx.pop_front();
+            return data;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+static void _uart_out32(u32 offset, u32 value)
+{
+    _drain_uart();
+
+    // Writing a full FIFO is dropped just like by the PS UART.
+    if (offset == XUARTPS_FIFO_OFFSET && uart_tx_fifo < host::UART_FIFO_SIZE)
+    {
+        uart_tx.push_back(value);
+        uart_tx_fifo++;
+    }
+}
+
+u32 host_in32(UINTPTR address)
+{
+    if (address == XPAR_AXI_PMOD_GPIO_BASEADDR + XGPIO_DATA_OFFSET)
+    {
+        ticks += host::GPIO_READ_TICKS;
+        return board ? board->read_gpio() : 0;
+    }
+
+    if (address >= STDOUT_BASEADDRESS && address < STDOUT_BASEADDRESS + 0x1000)
+    {
+        ticks += host::UART_ACCESS_TICKS;
+        return _uart_in32(address - STDOUT_BASEADDRESS);
+    }
+
+    if (address == GLOBAL_TMR_BASEADDR + GTIMER_COUNTER_LOWER_OFFSET)
+    {
+        ticks += host::TIMER_READ_TICKS;
+        return (u32)ticks;
+    }
+
+    return 0;
+}
+
+void host_out32(UINTPTR address, u32 value)
+{
+    if (address == XPAR_AXI_PMOD_GPIO_BASEADDR + XGPIO_DATA_OFFSET)
+    {
+        ticks += host::GPIO_WRITE_TICKS;
+        if (board) board->write_gpio(value, ticks);
+        return;
+    }
+
+    if (address >= STDOUT_BASEADDRESS && address < STDOUT_BASEADDRESS + 0x1000)
+    {
+        ticks += host::UART_ACCESS_TICKS;
+        _uart_out32(address - STDOUT_BASEADDRESS, value);
+    }
+}
+
+int XGpio_Initialize(XGpio* InstancePtr, UINTPTR BaseAddress)
+{
+    InstancePtr->BaseAddress = BaseAddress;
+    InstancePtr->IsReady = 1;
+
+    return XST_SUCCESS;
+}
+
+void XGpio_SetDataDirection(XGpio* InstancePtr, unsigned, u32 DirectionMask)
+{
+    Xil_Out32(InstancePtr->BaseAddress + XGPIO_TRI_OFFSET, DirectionMask);
+}
+
+void XGpio_DiscreteWrite(XGpio* InstancePtr, unsigned, u32 Mask)
+{
+    Xil_Out32(InstancePtr->BaseAddress + XGPIO_DATA_OFFSET, Mask);
+}
+
+u32 XGpio_DiscreteRead(XGpio* InstancePtr, unsigned)
+{
+    return Xil_In32(InstancePtr->BaseAddress + XGPIO_DATA_OFFSET);
+}
+
+void XTime_GetTime(XTime* Xtime_Global)
+{
+    *Xtime_Global = ticks;
+}
+
+// There is no interrupt controller on the host, which keeps the UART driver polled.
+int XSetupInterruptSystem(void*, void*, u32, UINTPTR, u16)
+{
+    return XST_FAILURE;
+}
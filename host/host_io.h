@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class PmodBoard;
+
+/*
+    Everything the firmware reaches through Xil_In32/Xil_Out32 when it runs on the host:
+    the PMOD GPIO is forwarded to the attached PmodBoard, the PS UART is a FIFO that drains
+    at the modelled baud rate and the global timer returns the modelled time.
+
+    There is no real time on the host. Every register access advances the modelled time by
+    a rough estimate of what it costs the ARM on the PYNQ-Z2, which makes the busy-wait delays
+    of the timing profiles terminate and gives comparable (not absolute) bus times.
+*/
+namespace host
+{
+    // Modelled costs in global timer ticks (COUNTS_PER_SECOND).
+    const uint64_t GPIO_WRITE_TICKS = 16;   // Posted write over M_AXI_GP0
+    const uint64_t GPIO_READ_TICKS = 48;    // Read round trip over M_AXI_GP0
+    const uint64_t UART_ACCESS_TICKS = 32;
+    const uint64_t TIMER_READ_TICKS = 8;
+
+    const uint32_t UART_FIFO_SIZE = 64;
+
+    uint64_t get_ticks();
+    double ticks_to_ns(uint64_t duration);
+
+    void attach_board(PmodBoard* board);
+
+    // Time it takes the UART to send a single byte, 0 sends everything immediately.
+    void set_uart_byte_ticks(uint64_t byte_ticks);
+    void set_uart_baud_rate(uint32_t baud_rate);
+
+    // Bytes sent by the firmware and bytes the PC sends to the firmware.
+    std::vector<uint8_t>& uart_transmitted();
+    void uart_receive(const uint8_t* data, size_t length);
+}
@@ -0,0 +1,205 @@
+#include "mbc_cartridge.h"
+
+#include "cartridge.h"
+
+#include <cstdlib>
+#include <cstring>
+
+const uint16_t RAM_BASE_ADDRESS = 0xa000;
+const uint16_t RAM_END_ADDRESS = 0xc000;
+
+static uint8_t _rom_size_code(unsigned rom_banks)
+{
+    uint8_t code = 0;
+    while ((2u << code) < rom_banks) code++;
+    return code;
+}
+
+static uint8_t _ram_size_code(unsigned ram_size)
+{
+    switch (ram_size)
+    {
+        case 0x2000:  return 0x02;
+        case 0x8000:  return 0x03;
+        case 0x20000: return 0x04;
+        case 0x10000: return 0x05;
+        default:      return 0x00;
+    }
+}
+
+MbcCartridge::MbcCartridge(MbcType type, uint8_t cartridge_type, unsigned rom_banks, unsigned ram_size):
+    rom(rom_banks * ROM_BANK_SIZE), ram(ram_size), type(type)
+{
+    for (uint8_t& byte : rom) byte = rand();
+    for (uint8_t& byte : ram) byte = rand();
+
+    // The MBC2 RAM only has the lower nibble.
+    if (type == MbcType::MBC2)
+        for (uint8_t& byte : ram) byte &= 0x0f;
+
+    cartridge_header header = {};
+    memcpy(header.nintendo_logo, NINTENDO_LOGO, sizeof(NINTENDO_LOGO));
+    memcpy(header.title, "HOST MODEL", 10);
+    header.cartridge_type = cartridge_type;
+    header.rom_size = _rom_size_code(rom_banks);
+    header.ram_size = _ram_size_code(ram_size);
+
+    uint8_t checksum = 0;
+    for (const uint8_t* byte = header.title; byte <= &header.rom_version; ++byte)
+        checksum = checksum - *byte - 1;
+    header.header_checksum = checksum;
+
+    memcpy(&rom[HEADER_BASE_ADDRESS], &header, sizeof(header));
+}
+
+unsigned MbcCartridge::_rom_offset(uint16_t address) const
+{
+    unsigned bank = 0;
+
+    if (address >= 0x4000)
+    {
+        bank = rom_bank;
+        if (type == MbcType::MBC1) bank |= bank2 << 5;
+    }
+    else if (type == MbcType::MBC1 && mode)
+    {
+        bank = bank2 << 5;
+    }
+
+    return (bank * ROM_BANK_SIZE + (address & 0x3fff)) % rom.size();
+}
+
+int MbcCartridge::_ram_offset(uint16_t address, bool chip_select) const
+{
+    if (!chip_select || address < RAM_BASE_ADDRESS || address >= RAM_END_ADDRESS) return -1;
+    if (!ram_enabled || ram.empty()) return -1;
+
+    switch (type)
+    {
+        // The 512 half-bytes are mirrored across the whole area.
+        case MbcType::MBC2:
+            return address & 0x1ff;
+
+        case MbcType::MBC1:
+            return ((mode ? bank2 : 0) * RAM_BANK_SIZE + (address - RAM_BASE_ADDRESS)) % ram.size();
+
+        // RAMB 0x08 - 0x0c selects the RTC registers on the MBC3.
+        case MbcType::MBC3:
+            if (ram_bank > 0x03) return -1;
+            [[fallthrough]];
+
+        case MbcType::MBC5:
+            return (ram_bank * RAM_BANK_SIZE + (address - RAM_BASE_ADDRESS)) % ram.size();
+    }
+
+    return -1;
+}
+
+void MbcCartridge::add_rom_read_fault(unsigned offset, uint8_t mask, unsigned count)
+{
+    rom_read_faults[offset] = { mask, count };
+}
+
+void MbcCartridge::add_ram_read_fault(unsigned offset, uint8_t mask, unsigned count)
+{
+    ram_read_faults[offset] = { mask, count };
+}
+
+void MbcCartridge::add_ram_write_fault(unsigned offset, unsigned count)
+{
+    ram_write_faults[offset] = { 0, count };
+}
+
+void MbcCartridge::clear_faults()
+{
+    rom_read_faults.clear();
+    ram_read_faults.clear();
+    ram_write_faults.clear();
+}
+
+uint8_t MbcCartridge::_apply_read_fault(std::map<unsigned, Fault>& faults, unsigned offset, uint8_t value)
+{
+    auto fault = faults.find(offset);
+    if (fault == faults.end()) return value;
+
+    value ^= fault->second.mask;
+    fault->second.mask = fault->second.mask << 1 | fault->second.mask >> 7;
+
+    if (fault->second.count != FAULT_PERSISTENT && --fault->second.count == 0)
+        faults.erase(fault);
+
+    return value;
+}
+
+bool MbcCartridge::_apply_write_fault(std::map<unsigned, Fault>& faults, unsigned offset)
+{
+    auto fault = faults.find(offset);
+    if (fault == faults.end()) return false;
+
+    if (fault->second.count != FAULT_PERSISTENT && --fault->second.count == 0)
+        faults.erase(fault);
+
+    return true;
+}
+
+uint8_t MbcCartridge::read(uint16_t address, bool chip_select)
+{
+    if (address < 0x8000)
+    {
+        unsigned offset = _rom_offset(address);
+        return _apply_read_fault(rom_read_faults, offset, rom[offset]);
+    }
+
+    int offset = _ram_offset(address, chip_select);
+    if (offset < 0) return OPEN_BUS;
+
+    uint8_t value = _apply_read_fault(ram_read_faults, offset, ram[offset]);
+
+    if (type == MbcType::MBC2)
+        return value | 0xf0;
+
+    return value;
+}
+
+void MbcCartridge::write(uint16_t address, uint8_t value, bool chip_select)
+{
+    if (address >= 0x8000)
+    {
+        int offset = _ram_offset(address, chip_select);
+        if (offset < 0 || _apply_write_fault(ram_write_faults, offset)) return;
+
+        ram[offset] = type == MbcType::MBC2 ? value & 0x0f : value;
+        return;
+    }
+
+    switch (type)
+    {
+        case MbcType::MBC1:
+            if (address < 0x2000)       ram_enabled = (value & 0x0f) == 0x0a;
+            else if (address < 0x4000)  rom_bank = (value & 0x1f) ? (value & 0x1f) : 1;
+            else if (address < 0x6000)  bank2 = value & 0x03;
+            else                        mode = value & 0x01;
+            break;
+
+        // A8 selects between RAMG and ROMB in the lower area, the upper area has no registers.
+        case MbcType::MBC2:
+            if (address >= 0x4000)      break;
+            if (address & 0x0100)       rom_bank = (value & 0x0f) ? (value & 0x0f) : 1;
+            else                        ram_enabled = (value & 0x0f) == 0x0a;
+            break;
+
+        case MbcType::MBC3:
+            if (address < 0x2000)       ram_enabled = (value & 0x0f) == 0x0a;
+            else if (address < 0x4000)  rom_bank = (value & 0x7f) ? (value & 0x7f) : 1;
+            else if (address < 0x6000)  ram_bank = value;
+            break;
+
+        // MBC5 is the only one that maps bank 0 into area 2 and needs exactly 0x0a to enable the RAM.
+        case MbcType::MBC5:
+            if (address < 0x2000)       ram_enabled = value == 0x0a;
+            else if (address < 0x3000)  rom_bank = (rom_bank & 0x100) | value;
+            else if (address < 0x4000)  rom_bank = (rom_bank & 0xff) | ((value & 0x01) << 8);
+            else if (address < 0x6000)  ram_bank = value & 0x0f;
+            break;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "pmod_board.h"
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/*
+    Register behaviour of the MBC1/MBC2/MBC3/MBC5 mappers with ROM and RAM images behind them,
+    following the Pan Docs and the Game Boy: Complete Technical Reference.
+
+    Only what the reader touches is modelled: ROM/RAM banking, the RAM enable, the MBC1 banking
+    mode and the 4 bit wide MBC2 RAM. The MBC3 RTC registers read as open bus.
+
+    Faults can be injected per byte of the images to exercise the consensus and verify modes.
+    A faulty read flips the bits of its mask, rotated by one more bit on every faulty read, so
+    a byte that keeps failing returns a different value every time like a dirty contact would.
+    A faulty write is simply lost. The count says how many reads or writes fail before the byte
+    behaves again, FAULT_PERSISTENT makes it fail for good.
+*/
+enum class MbcType
+{
+    MBC1,
+    MBC2,
+    MBC3,
+    MBC5
+};
+
+class MbcCartridge: public Cartridge
+{
+public:
+    MbcCartridge(MbcType type, uint8_t cartridge_type, unsigned rom_banks, unsigned ram_size);
+
+    uint8_t read(uint16_t address, bool chip_select) override;
+    void write(uint16_t address, uint8_t value, bool chip_select) override;
+
+    static const unsigned FAULT_PERSISTENT = ~0u;
+
+    // Offsets are into rom and ram.
+    void add_rom_read_fault(unsigned offset, uint8_t mask, unsigned count);
+    void add_ram_read_fault(unsigned offset, uint8_t mask, unsigned count);
+    void add_ram_write_fault(unsigned offset, unsigned count);
+    void clear_faults();
+
+    // Bank 0 starts with a valid header for the cartridge type, everything else is random.
+    std::vector<uint8_t> rom;
+    std::vector<uint8_t> ram;
+
+    const MbcType type;
+
+private:
+    struct Fault
+    {
+        uint8_t mask;
+        unsigned count;
+    };
+
+    std::map<unsigned, Fault> rom_read_faults;
+    std::map<unsigned, Fault> ram_read_faults;
+    std::map<unsigned, Fault> ram_write_faults;
+
+    bool ram_enabled = false;
+    uint16_t rom_bank = 1;
+    uint8_t ram_bank = 0;
+
+    // MBC1 only
+    uint8_t bank2 = 0;
+    bool mode = false;
+
+    unsigned _rom_offset(uint16_t address) const;
+    int _ram_offset(uint16_t address, bool chip_select) const;
+
+    static uint8_t _apply_read_fault(std::map<unsigned, Fault>& faults, unsigned offset, uint8_t value);
+    static bool _apply_write_fault(std::map<unsigned, Fault>& faults, unsigned offset);
+};
@@ -0,0 +1,88 @@
+#include "pmod_board.h"
+
+#include "pmod.h"
+
+PmodBoard::PmodBoard(Cartridge& cartridge): cartridge(cartridge)
+{
+}
+
+void PmodBoard::write_gpio(uint16_t value, uint64_t now)
+{
+    const PmodState previous = { .value = gpio };
+    const PmodState next = { .value = value };
+
+    auto rising = [&](PmodSignals signal) { return !((previous.value >> signal) & 1) && ((next.value >> signal) & 1); };
+    auto falling = [&](PmodSignals signal) { return ((previous.value >> signal) & 1) && !((next.value >> signal) & 1); };
+
+    counters.gpio_writes++;
+    gpio = value;
+
+    if (rising(PmodSignals::ADDR_SCLK))
+        address_shift = (address_shift << 1) | next.ADDR_SDATA;
+
+    if (rising(PmodSignals::ADDR_RCLK))
+    {
+        // Changing the address in the middle of a write corrupts whatever is being written.
+        if (!previous.WRn) counters.protocol_errors++;
+
+        if (address != address_shift) bus_change = now;
+        address = address_shift;
+    }
+
+    if (rising(PmodSignals::DATA_OUT_SCLK))
+        data_out_shift = (data_out_shift << 1) | next.DATA_OUT_SDATA;
+
+    if (rising(PmodSignals::DATA_OUT_RCLK))
+        data_out = data_out_shift;
+
+    if (previous.RDn != next.RDn || previous.CSn != next.CSn)
+        bus_change = now;
+
+    // Both strobes at once or the board driving the bus while the cartridge does.
+    if (!next.RDn && (!next.WRn || !next.DATA_OUT_OEn))
+        counters.protocol_errors++;
+
+    if (falling(PmodSignals::WRn))
+        write_start = now;
+
+    // Cartridge RAM and the mapper registers take the data on the rising edge of WRn.
+    if (rising(PmodSignals::WRn))
+    {
+        if (previous.DATA_OUT_OEn) counters.protocol_errors++;
+        if (now - write_start < access_ticks) counters.timing_violations++;
+
+        counters.cartridge_writes++;
+        cartridge.write(address, data_out, !previous.CSn);
+    }
+
+    if (rising(PmodSignals::DATA_IN_RCLK))
+    {
+        if (next.RDn)
+        {
+            data_in_latch = OPEN_BUS;
+        }
+        else
+        {
+            if (now - bus_change < access_ticks) counters.timing_violations++;
+
+            counters.cartridge_reads++;
+            data_in_latch = cartridge.read(address, !next.CSn);
+        }
+    }
+
+    // The parallel load is asynchronous, the shift register follows the latch while PLn is low.
+    if (!next.DATA_IN_PLn)
+        data_in_shift = data_in_latch;
+    else if (rising(PmodSignals::DATA_IN_SCLK))
+        data_in_shift <<= 1;
+}
+
+uint16_t PmodBoard::read_gpio()
+{
+    counters.gpio_reads++;
+
+    PmodState state = { .value = gpio };
+    state.DATA_IN_SDATA = data_in_shift >> 7;
+
+    return state.value;
+}
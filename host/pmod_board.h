@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    Bit-level model of the PMOD interface board for running the firmware on a plain Linux box.
+
+    Every value the firmware writes to the PMOD GPIO is decoded edge by edge like the board does:
+      - two 74HC595 form the 16 bit address chain (ADDR_SCLK/ADDR_SDATA, latched by ADDR_RCLK)
+      - one 74HC595 holds the data driven onto the cartridge bus (DATA_OUT_*, driven while OEn is low)
+      - the 74HC597 latches the cartridge bus on DATA_IN_RCLK, DATA_IN_PLn copies the latch into
+        the shift register and DATA_IN_SCLK shifts it out MSB first on DATA_IN_SDATA
+
+    The cartridge behind the connector is a Cartridge implementation. Anything the real hardware
+    would not survive (e.g. both strobes at once, the board and the cartridge driving the bus
+    together) is counted as a protocol error, bytes sampled or written before the cartridge
+    access time passed are counted as timing violations.
+*/
+class Cartridge
+{
+public:
+    virtual ~Cartridge() = default;
+
+    // Called while RDn is low, returns what the cartridge drives onto the data bus.
+    virtual uint8_t read(uint16_t address, bool chip_select) = 0;
+
+    // Called on the rising edge of WRn.
+    virtual void write(uint16_t address, uint8_t value, bool chip_select) = 0;
+};
+
+// Data bus value while nothing drives it (the bus has pull-ups).
+const uint8_t OPEN_BUS = 0xff;
+
+struct PmodBoardCounters
+{
+    uint64_t gpio_writes;
+    uint64_t gpio_reads;
+    uint64_t cartridge_reads;
+    uint64_t cartridge_writes;
+    uint64_t protocol_errors;
+    uint64_t timing_violations;
+};
+
+class PmodBoard
+{
+public:
+    explicit PmodBoard(Cartridge& cartridge);
+
+    void write_gpio(uint16_t value, uint64_t now);
+    uint16_t read_gpio();
+
+    // Minimum time the cartridge needs from an address/strobe change until the data is valid.
+    void set_access_ticks(uint64_t ticks) { access_ticks = ticks; }
+
+    const PmodBoardCounters& get_counters() const { return counters; }
+    void reset_counters() { counters = {}; }
+
+private:
+    Cartridge& cartridge;
+    uint64_t access_ticks = 0;
+
+    uint16_t gpio = 0xffff;
+
+    uint16_t address_shift = 0;
+    uint16_t address = 0;
+    uint8_t data_out_shift = 0;
+    uint8_t data_out = 0;
+    uint8_t data_in_latch = OPEN_BUS;
+    uint8_t data_in_shift = OPEN_BUS;
+
+    // Last time the address or a strobe changed, the cartridge output is only valid after access_ticks.
+    uint64_t bus_change = 0;
+    uint64_t write_start = 0;
+
+    PmodBoardCounters counters = {};
+};
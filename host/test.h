@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdio>
+
+/*
+    Minimal test helpers for the host programs, a failed CHECK is reported and
+    counted but does not stop the test so one run shows everything that broke.
+*/
+inline unsigned test_failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define RUN_NAMED_TEST(name, call) do { \
+        unsigned failures_before = test_failures; \
+        call; \
+        printf("%-40s %s\n", name, test_failures == failures_before ? "ok" : "FAILED"); \
+    } while (0)
+
+#define RUN_TEST(call) RUN_NAMED_TEST(#call, call)
+
+inline int test_summary()
+{
+    if (test_failures != 0)
+    {
+        printf("%u check(s) failed\n", test_failures);
+        return 1;
+    }
+
+    printf("all tests passed\n");
+    return 0;
+}
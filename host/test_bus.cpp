@@ -0,0 +1,157 @@
+/*
+    Runs bus_read/bus_write of the firmware against the bit-level model of the PMOD board.
+
+    The cartridge is a flat 64 KiB memory, so every byte the pipelined bus_read returns
+    can be checked against the address it was supposed to come from, in burst mode and with
+    the strobes toggled for every byte.
+*/
+#include "host_io.h"
+#include "pmod_board.h"
+#include "test.h"
+
+#include "bus.h"
+#include "timing.h"
+#include "uart.h"
+
+#include <cstdlib>
+#include <cstring>
+
+const uint16_t RAM_BASE_ADDRESS = 0xa000;
+const uint16_t RAM_END_ADDRESS = 0xc000;
+
+// Slowest access time any of the timing profiles has to cover.
+const uint32_t ACCESS_TIME_NS = 150;
+
+class FlatCartridge: public Cartridge
+{
+public:
+    uint8_t memory[0x10000];
+    unsigned register_writes = 0;
+
+    uint8_t read(uint16_t address, bool chip_select) override
+    {
+        // The RAM only answers with CSn asserted and the ROM only without.
+        if (_is_ram(address) != chip_select) return OPEN_BUS;
+        return memory[address];
+    }
+
+    void write(uint16_t address, uint8_t value, bool chip_select) override
+    {
+        if (!chip_select)
+        {
+            register_writes++;
+            return;
+        }
+
+        if (_is_ram(address)) memory[address] = value;
+    }
+
+private:
+    static bool _is_ram(uint16_t address)
+    {
+        return address >= RAM_BASE_ADDRESS && address < RAM_END_ADDRESS;
+    }
+};
+
+static FlatCartridge cartridge;
+static PmodBoard board(cartridge);
+
+static void test_random_reads(bool burst)
+{
+    static uint8_t buffer[0x4000];
+
+    bus_burst_reads = burst;
+
+    for (unsigned i = 0; i < 300; ++i)
+    {
+        uint16_t count = 1 + rand() % 0x200;
+        bool ram = rand() & 1;
+
+        uint16_t base_address = ram
+            ? RAM_BASE_ADDRESS + rand() % (RAM_END_ADDRESS - RAM_BASE_ADDRESS - count)
+            : rand() % (0x8000 - count);
+
+        memset(buffer, 0, count);
+        bus_read(base_address, buffer, count, ram);
+
+        CHECK(!memcmp(buffer, &cartridge.memory[base_address], count));
+    }
+
+    // A whole ROM bank at once, like read_rom does.
+    bus_read(0x4000, buffer, sizeof(buffer), false);
+    CHECK(!memcmp(buffer, &cartridge.memory[0x4000], sizeof(buffer)));
+}
+
+static void test_register_writes()
+{
+    unsigned register_writes = cartridge.register_writes;
+    uint8_t before = cartridge.memory[0x2000];
+
+    bus_write_register(0x2000, 0x5a);
+
+    CHECK(cartridge.register_writes == register_writes + 1);
+    CHECK(cartridge.memory[0x2000] == before);
+}
+
+static void test_ram_writes()
+{
+    uint8_t source[0x200];
+    for (unsigned i = 0; i < sizeof(source); ++i)
+        source[i] = rand();
+
+    bus_write(0xa123, source, sizeof(source));
+
+    CHECK(!memcmp(source, &cartridge.memory[0xa123], sizeof(source)));
+}
+
+// The queued bytes have to go out while the cartridge is being read, not only on Uart_Flush.
+static void test_uart_overlap()
+{
+    static uint8_t buffer[0x4000];
+    static uint8_t queued[0x1000];
+
+    for (unsigned i = 0; i < sizeof(queued); ++i)
+        queued[i] = rand();
+
+    host::set_uart_baud_rate(3000000);
+    host::uart_transmitted().clear();
+
+    Uart_QueueBytes(STDOUT_BASEADDRESS, queued, sizeof(queued));
+    bus_read(0x4000, buffer, sizeof(buffer), false);
+
+    CHECK(host::uart_transmitted().size() > sizeof(queued) / 2);
+
+    Uart_Flush();
+
+    CHECK(host::uart_transmitted().size() == sizeof(queued));
+    CHECK(!memcmp(host::uart_transmitted().data(), queued, sizeof(queued)));
+
+    host::set_uart_byte_ticks(0);
+}
+
+int main()
+{
+    srand(1);
+
+    for (unsigned i = 0; i < sizeof(cartridge.memory); ++i)
+        cartridge.memory[i] = rand();
+
+    host::attach_board(&board);
+    board.set_access_ticks(ns_to_ticks(ACCESS_TIME_NS));
+
+    CHECK(bus_init() == XST_SUCCESS);
+
+    // The conservative profile is the one used before the cartridge type is known.
+    select_default_timing_profile();
+
+    RUN_TEST(test_random_reads(true));
+    RUN_TEST(test_random_reads(false));
+    RUN_TEST(test_register_writes());
+    RUN_TEST(test_ram_writes());
+    RUN_TEST(test_uart_overlap());
+
+    CHECK(board.get_counters().protocol_errors == 0);
+    CHECK(board.get_counters().timing_violations == 0);
+
+    return test_summary();
+}
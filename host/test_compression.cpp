@@ -0,0 +1,207 @@
+/*
+    Round trips banks through the C codec of the firmware and cross-checks it with python/compression.py:
+
+        test_compression FIXTURE STREAMS
+
+    decodes every stream python wrote into FIXTURE (see test_compression.py --write) and writes
+    the streams of the C codec to STREAMS, which test_compression.py decodes in turn.
+*/
+#include "test.h"
+
+#include "compression.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Bank;
+
+struct Record
+{
+    Bank bank;
+    Bank stream;
+};
+
+static std::vector<Record> c_records;
+
+static Bank _random_bytes(size_t length)
+{
+    Bank bank(length);
+    for (uint8_t& byte : bank) byte = rand();
+    return bank;
+}
+
+static Bank _repeat(const Bank& pattern, size_t length)
+{
+    Bank bank(length);
+    for (size_t i = 0; i < length; ++i) bank[i] = pattern[i % pattern.size()];
+    return bank;
+}
+
+// Compresses and decompresses the bank, returns the compressed size (0 if it did not get smaller).
+static uint16_t _round_trip(const Bank& bank)
+{
+    // A bank that does not get smaller never needs more than its own size.
+    Bank stream(bank.size());
+    uint16_t stream_length = compress_bank(bank.data(), bank.size(), stream.data());
+
+    CHECK(stream_length < bank.size());
+    stream.resize(stream_length);
+
+    c_records.push_back({ bank, stream });
+
+    if (stream_length == 0)
+        return 0;
+
+    Bank output(bank.size());
+    CHECK(decompress_bank(stream.data(), stream_length, output.data(), bank.size()));
+    CHECK(output == bank);
+
+    return stream_length;
+}
+
+static void test_incompressible()
+{
+    CHECK(_round_trip(_random_bytes(0x4000)) == 0);
+    CHECK(_round_trip(_random_bytes(0x200)) == 0);
+    CHECK(_round_trip(_random_bytes(2)) == 0);
+}
+
+// A run of equal bytes is one literal and matches of distance 1 that overlap what they produce.
+static void test_all_equal()
+{
+    for (uint8_t value : { 0x00, 0xff, 0x5a })
+    {
+        // 1 literal + 1 match of up to 130 bytes per 3 stream bytes.
+        uint16_t length = _round_trip(Bank(0x4000, value));
+        CHECK(length == 2 + (0x4000 - 1 + 129) / 130 * 3);
+
+        CHECK(_round_trip(Bank(0x2000, value)) != 0);
+        CHECK(_round_trip(Bank(0x200, value)) != 0);
+    }
+}
+
+static void test_overlapping_matches()
+{
+    for (size_t period : { 2, 3, 5, 127, 200 })
+        CHECK(_round_trip(_repeat(_random_bytes(period), 0x4000)) != 0);
+
+    // Matches far back and literal runs longer than a single token.
+    Bank far = _random_bytes(0x1000);
+    Bank bank = far;
+    bank.insert(bank.end(), far.begin(), far.end());
+    CHECK(_round_trip(bank) != 0);
+
+    Bank literals = _random_bytes(300);
+    literals.resize(600, 0);
+    CHECK(_round_trip(literals) != 0);
+}
+
+static void test_corrupt_streams()
+{
+    Bank bank(0x100, 0xff);
+    Bank stream(bank.size());
+    uint16_t stream_length = compress_bank(bank.data(), bank.size(), stream.data());
+
+    Bank output(bank.size());
+
+    // Truncated, decompressing to the wrong length and reaching back before the start.
+    CHECK(!decompress_bank(stream.data(), stream_length - 1, output.data(), bank.size()));
+    CHECK(!decompress_bank(stream.data(), stream_length, output.data(), bank.size() - 1));
+    CHECK(!decompress_bank(stream.data(), stream_length, output.data(), bank.size() + 1));
+
+    const uint8_t before_start[] = { 0x00, 0xff, 0x80, 0x02, 0x00 };
+    CHECK(!decompress_bank(before_start, sizeof(before_start), output.data(), 4));
+
+    const uint8_t zero_distance[] = { 0x00, 0xff, 0x80, 0x00, 0x00 };
+    CHECK(!decompress_bank(zero_distance, sizeof(zero_distance), output.data(), 4));
+}
+
+static bool _read_records(const char* path, std::vector<Record>& records)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+
+    uint8_t header[4];
+    while (fread(header, 1, sizeof(header), file) == sizeof(header))
+    {
+        Record record;
+        record.stream.resize(header[2] | header[3] << 8);
+        record.bank.resize(header[0] | header[1] << 8);
+
+        if (fread(record.stream.data(), 1, record.stream.size(), file) != record.stream.size() ||
+            fread(record.bank.data(), 1, record.bank.size(), file) != record.bank.size())
+            break;
+
+        records.push_back(record);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void _write_records(const char* path, const std::vector<Record>& records)
+{
+    FILE* file = fopen(path, "wb");
+    CHECK(file != nullptr);
+    if (!file) return;
+
+    for (const Record& record : records)
+    {
+        const uint8_t header[4] = {
+            (uint8_t)record.bank.size(), (uint8_t)(record.bank.size() >> 8),
+            (uint8_t)record.stream.size(), (uint8_t)(record.stream.size() >> 8)
+        };
+
+        fwrite(header, 1, sizeof(header), file);
+        fwrite(record.stream.data(), 1, record.stream.size(), file);
+        fwrite(record.bank.data(), 1, record.bank.size(), file);
+    }
+
+    fclose(file);
+}
+
+static void test_python_streams(const char* path)
+{
+    std::vector<Record> records;
+    CHECK(_read_records(path, records));
+    CHECK(!records.empty());
+
+    for (const Record& record : records)
+    {
+        Bank stream(record.bank.size());
+        uint16_t stream_length = compress_bank(record.bank.data(), record.bank.size(), stream.data());
+
+        // Both sides have to agree on what is worth compressing.
+        CHECK((stream_length == 0) == record.stream.empty());
+
+        if (record.stream.empty())
+            continue;
+
+        Bank output(record.bank.size());
+        CHECK(decompress_bank(record.stream.data(), record.stream.size(), output.data(), output.size()));
+        CHECK(output == record.bank);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        printf("usage: %s FIXTURE STREAMS\n", argv[0]);
+        return 2;
+    }
+
+    srand(1);
+
+    RUN_TEST(test_incompressible());
+    RUN_TEST(test_all_equal());
+    RUN_TEST(test_overlapping_matches());
+    RUN_TEST(test_corrupt_streams());
+    RUN_TEST(test_python_streams(argv[1]));
+
+    _write_records(argv[2], c_records);
+
+    return test_summary();
+}
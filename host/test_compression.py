@@ -0,0 +1,119 @@
+# Cross-checks the C codec (src/compression.cpp) against python/compression.py.
+#
+#   python3 test_compression.py STREAMS     decodes the streams written by test_compression
+#   python3 test_compression.py --write     regenerates compression_fixture.bin, which
+#                                           test_compression decodes with the C codec
+#
+# Both files are sequences of records: u16 length, u16 stream length (0 if the bank
+# did not get smaller), the stream and then the original bank (little endian).
+
+import os
+import random
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "python"))
+
+import compression
+
+FIXTURE = os.path.join(os.path.dirname(os.path.abspath(__file__)), "compression_fixture.bin")
+
+
+def read_records(path):
+    with open(path, "rb") as file:
+        data = file.read()
+
+    records = []
+    position = 0
+
+    while position < len(data):
+        length, stream_length = struct.unpack_from("<HH", data, position)
+        position += 4
+
+        stream = data[position:position + stream_length]
+        position += stream_length
+
+        bank = data[position:position + length]
+        position += length
+
+        records.append((bank, stream))
+
+    return records
+
+
+def write_records(path, records):
+    with open(path, "wb") as file:
+        for bank, stream in records:
+            file.write(struct.pack("<HH", len(bank), len(stream)) + stream + bank)
+
+
+# Same kinds of banks as test_compression.cpp, generated independently so the
+# fixture does not depend on the C side.
+def fixture_banks():
+    rng = random.Random(1)
+
+    tile = bytes(rng.randrange(256) for _ in range(16))
+    tiles = bytearray()
+    for _ in range(0x4000 // 16):
+        tiles += tile if rng.randrange(4) else bytes(rng.randrange(256) for _ in range(16))
+
+    far = bytes(rng.randrange(256) for _ in range(0x300))
+
+    return [
+        ("incompressible", bytes(rng.randrange(256) for _ in range(0x1000))),
+        ("all 0xff", b"\xff" * 0x4000),
+        ("all 0x00", bytes(0x2000)),
+        ("mbc2 ram", b"\x0f" * 0x200),
+        ("period 2", b"\x12\x34" * 0x800),
+        ("period 5", b"abcde" * 500),
+        ("tiles", bytes(tiles)),
+        ("far match", far + far + far[:0x100]),
+        ("short", b"\x01\x02\x01\x02\x01\x02\x01"),
+        ("literal runs", bytes(rng.randrange(256) for _ in range(300)) + bytes(300)),
+    ]
+
+
+def main():
+    if sys.argv[1:] == ["--write"]:
+        records = []
+
+        for name, bank in fixture_banks():
+            stream = compression.compress(bank) or b""
+            records.append((bank, stream))
+            print(f"{name:<20} {len(bank):>6}B -> {len(stream):>6}B")
+
+        write_records(FIXTURE, records)
+        return 0
+
+    if len(sys.argv) != 2:
+        print(__doc__ or "usage: test_compression.py STREAMS | --write")
+        return 2
+
+    failures = 0
+    records = read_records(sys.argv[1])
+
+    for i, (bank, stream) in enumerate(records):
+        if not stream:
+            if compression.compress(bank) is not None:
+                print(f"record {i}: the C codec did not compress it, python did")
+                failures += 1
+            continue
+
+        try:
+            if compression.decompress(stream, len(bank)) != bank:
+                print(f"record {i}: decompressed to different bytes")
+                failures += 1
+        except ValueError as error:
+            print(f"record {i}: {error}")
+            failures += 1
+
+    if failures:
+        print(f"{failures} of {len(records)} record(s) failed")
+        return 1
+
+    print(f"all {len(records)} C streams decoded by python")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,164 @@
+/*
+    Known-answer tests for crc32, byte_sum and SHA-1 of hash.cpp.
+
+    The expected values come from zlib and hashlib, which reader.py checks the board against.
+    hash.cpp is built twice, test_hash_single_table with __riscv defined to get the single table
+    CRC-32 of the MicroBlaze-V, so both CRC paths have to pass the same tests. The NEON byte_sum
+    is only built and tested where the host compiler targets ARM.
+*/
+#include "test.h"
+
+#include "hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static std::vector<uint8_t> _pattern(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; ++i) data[i] = (i * 131 + 7) ^ (i >> 3);
+    return data;
+}
+
+static const uint8_t* _bytes(const char* text)
+{
+    return (const uint8_t*)text;
+}
+
+static std::string _sha1(const uint8_t* data, size_t length)
+{
+    sha1_context context;
+    uint8_t digest[SHA1_DIGEST_SIZE];
+
+    sha1_init(context);
+    sha1_update(context, data, length);
+    sha1_final(context, digest);
+
+    char hex[2 * SHA1_DIGEST_SIZE + 1];
+    for (unsigned i = 0; i < SHA1_DIGEST_SIZE; ++i)
+        snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+
+    return hex;
+}
+
+// Bit by bit, independent of the tables of hash.cpp.
+static uint32_t _reference_crc32(const uint8_t* data, size_t length)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        crc ^= data[i];
+        for (unsigned bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+    }
+
+    return ~crc;
+}
+
+static void test_crc32()
+{
+    CHECK(crc32(0, nullptr, 0) == 0);
+    CHECK(crc32(0, _bytes("123456789"), 9) == 0xcbf43926);
+
+    std::vector<uint8_t> data = _pattern(1000);
+    CHECK(crc32(0, data.data(), data.size()) == 0xbcf7fdd7);
+    CHECK(crc32(0, &data[3], 995) == 0xef5945dc);
+
+    std::vector<uint8_t> a(1000000, 'a');
+    CHECK(crc32(0, a.data(), a.size()) == 0xdc25bfbc);
+}
+
+// Every start alignment and length around the 4 byte steps of the sliced CRC and the 16 byte steps of NEON.
+static void test_unaligned_tails()
+{
+    std::vector<uint8_t> data = _pattern(128);
+
+    for (size_t offset = 0; offset < 8; ++offset)
+    {
+        for (size_t length = 0; offset + length <= 80; ++length)
+        {
+            const uint8_t* start = &data[offset];
+
+            uint32_t sum = 0;
+            for (size_t i = 0; i < length; ++i) sum += start[i];
+
+            CHECK(crc32(0, start, length) == _reference_crc32(start, length));
+            CHECK(byte_sum(0, start, length) == sum);
+        }
+    }
+}
+
+// Feeding the result back in has to give the same as a single call, whatever the split.
+static void test_incremental()
+{
+    std::vector<uint8_t> data = _pattern(1000);
+
+    for (size_t split : { 1, 3, 7, 63, 64, 65, 500, 999 })
+    {
+        CHECK(crc32(crc32(0, data.data(), split), &data[split], data.size() - split) == 0xbcf7fdd7);
+        CHECK(byte_sum(byte_sum(0, data.data(), split), &data[split], data.size() - split) == 128060);
+
+        sha1_context context;
+        uint8_t digest[SHA1_DIGEST_SIZE], expected[SHA1_DIGEST_SIZE];
+
+        sha1_init(context);
+        for (size_t offset = 0; offset < data.size(); offset += split)
+            sha1_update(context, &data[offset], split < data.size() - offset ? split : data.size() - offset);
+        sha1_final(context, digest);
+
+        sha1_init(context);
+        sha1_update(context, data.data(), data.size());
+        sha1_final(context, expected);
+
+        CHECK(!memcmp(digest, expected, sizeof(digest)));
+    }
+}
+
+static void test_byte_sum()
+{
+    CHECK(byte_sum(0, nullptr, 0) == 0);
+    CHECK(byte_sum(5, nullptr, 0) == 5);
+
+    std::vector<uint8_t> data = _pattern(1000);
+    CHECK(byte_sum(0, data.data(), data.size()) == 128060);
+    CHECK(byte_sum(0, &data[3], 995) == 127641);
+
+    // A whole MBC5 ROM of 0xff must not overflow any of the partial sums.
+    std::vector<uint8_t> ff(0x4000, 0xff);
+    uint32_t sum = 0;
+    for (unsigned bank = 0; bank < 512; ++bank)
+        sum = byte_sum(sum, ff.data(), ff.size());
+
+    CHECK(sum == 512u * 0x4000 * 0xff);
+}
+
+static void test_sha1()
+{
+    CHECK(_sha1(nullptr, 0) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    CHECK(_sha1(_bytes("abc"), 3) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+
+    // 56 bytes, the padding no longer fits the block.
+    const char* two_blocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    CHECK(_sha1(_bytes(two_blocks), strlen(two_blocks)) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+    std::vector<uint8_t> data = _pattern(1000);
+    CHECK(_sha1(data.data(), data.size()) == "555634b0fa12d8054ce71ecc5e4ec6acd12c9724");
+    CHECK(_sha1(&data[3], 995) == "027a75d2c8ee39e313311a292e1bc572f0bbb220");
+
+    std::vector<uint8_t> a(1000000, 'a');
+    CHECK(_sha1(a.data(), a.size()) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+}
+
+int main()
+{
+    RUN_TEST(test_crc32());
+    RUN_TEST(test_unaligned_tails());
+    RUN_TEST(test_incremental());
+    RUN_TEST(test_byte_sum());
+    RUN_TEST(test_sha1());
+
+    return test_summary();
+}
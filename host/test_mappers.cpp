@@ -0,0 +1,224 @@
+/*
+    Runs the mapper routines of cartridge.cpp against the MBC models with their timing profiles,
+    reading every interesting ROM bank and every RAM bank back from the images and writing RAM.
+    Faults injected into the models check that the consensus mode corrects and counts flipped bits
+    and that the verify mode rewrites dropped writes.
+*/
+#include "cartridges.h"
+#include "host_io.h"
+#include "pmod_board.h"
+#include "test.h"
+
+#include "cartridge.h"
+#include "bus.h"
+#include "timing.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <xstatus.h>
+
+// Bank 0, the MBC1 banks that alias area 1 and the ones using the upper bank bits.
+const uint16_t ROM_BANKS_TO_CHECK[] = { 0, 1, 2, 0x0f, 0x10, 0x1f, 0x20, 0x21, 0x40, 0x60, 0x7f, 0x80, 0x100, 0x1ff };
+
+template <typename Mapper>
+static void test_rom(const MbcCartridge& cartridge)
+{
+    const unsigned num_banks = cartridge.rom.size() / ROM_BANK_SIZE;
+
+    Mapper::reset();
+
+    for (uint16_t bank : ROM_BANKS_TO_CHECK)
+    {
+        if (bank >= num_banks) continue;
+
+        read_rom<Mapper>(bank);
+        CHECK(!memcmp(cartridge_buffer, &cartridge.rom[bank * ROM_BANK_SIZE], ROM_BANK_SIZE));
+    }
+
+    // Part of a bank ends up at the start of the buffer.
+    read_rom<Mapper>(num_banks - 1, 0x1234, 0x100);
+    CHECK(!memcmp(cartridge_buffer, &cartridge.rom[(num_banks - 1) * ROM_BANK_SIZE + 0x1234], 0x100));
+}
+
+template <typename Mapper>
+static void test_ram(MbcCartridge& cartridge)
+{
+    const unsigned num_banks = cartridge.ram.size() / Mapper::RAM_BANK_SIZE;
+
+    Mapper::reset();
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        read_ram<Mapper>(bank);
+        CHECK(!memcmp(cartridge_buffer, &cartridge.ram[bank * Mapper::RAM_BANK_SIZE], Mapper::RAM_BANK_SIZE));
+    }
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        for (unsigned i = 0; i < Mapper::RAM_BANK_SIZE; ++i)
+            cartridge_buffer[i] = rand() & Mapper::RAM_DATA_MASK;
+
+        write_ram<Mapper>(bank);
+        CHECK(!memcmp(cartridge_buffer, &cartridge.ram[bank * Mapper::RAM_BANK_SIZE], Mapper::RAM_BANK_SIZE));
+    }
+
+    // Only the bytes that differ are written by the delta mode.
+    read_ram<Mapper>(0);
+    for (unsigned i = 0; i < 10; ++i)
+        cartridge_buffer[i * 37] ^= 0x05;
+
+    CHECK(write_ram_delta<Mapper>(0) == 10);
+    CHECK(!memcmp(cartridge_buffer, &cartridge.ram[0], Mapper::RAM_BANK_SIZE));
+
+    verify_result result;
+    verify_written_ram<Mapper>(0, result);
+    CHECK(result.mismatches == 0 && result.rewrites == 0 && result.unresolved == 0);
+}
+
+// A transient flip is outvoted after the correct value got the absolute majority of all votes.
+const unsigned RETRIES_TO_MAJORITY = (2 + CONSENSUS_RETRIES) / 2;
+
+// The first read of every faulty byte is flipped, the rest are right. A persistent fault reads
+// differently every time, so no value gets the majority.
+template <typename Mapper>
+static void test_consensus(MbcCartridge& cartridge)
+{
+    const unsigned rom_bank = cartridge.rom.size() / ROM_BANK_SIZE - 1;
+    const unsigned rom_base = rom_bank * ROM_BANK_SIZE;
+    const unsigned transient_offsets[] = { 0, 0x10, 0x2000, ROM_BANK_SIZE - 1 };
+
+    consensus_result result;
+
+    Mapper::reset();
+
+    for (unsigned offset : transient_offsets)
+        cartridge.add_rom_read_fault(rom_base + offset, 0x81, 1);
+
+    read_rom<Mapper>(rom_bank);
+    verify_rom<Mapper>(rom_bank, result);
+
+    CHECK(result.mismatches == 4);
+    CHECK(result.retries == 4 * RETRIES_TO_MAJORITY);
+    CHECK(result.unresolved == 0);
+    CHECK(!memcmp(cartridge_buffer, &cartridge.rom[rom_base], ROM_BANK_SIZE));
+
+    cartridge.add_rom_read_fault(rom_base + 0x100, 0x01, MbcCartridge::FAULT_PERSISTENT);
+
+    read_rom<Mapper>(rom_bank);
+    verify_rom<Mapper>(rom_bank, result);
+
+    CHECK(result.mismatches == 1);
+    CHECK(result.retries == CONSENSUS_RETRIES);
+    CHECK(result.unresolved == 1);
+
+    cartridge.clear_faults();
+
+    // The RAM only has the bits of RAM_DATA_MASK, so the faults stay within them.
+    const unsigned ram_bank = cartridge.ram.size() / Mapper::RAM_BANK_SIZE - 1;
+    const unsigned ram_base = ram_bank * Mapper::RAM_BANK_SIZE;
+
+    cartridge.add_ram_read_fault(ram_base + 1, 0x01, 1);
+    cartridge.add_ram_read_fault(ram_base + Mapper::RAM_BANK_SIZE - 1, 0x08, 1);
+    cartridge.add_ram_read_fault(ram_base + 0x40, 0x01, MbcCartridge::FAULT_PERSISTENT);
+
+    read_ram<Mapper>(ram_bank);
+    verify_ram<Mapper>(ram_bank, result);
+
+    CHECK(result.mismatches == 3);
+    CHECK(result.retries == 2 * RETRIES_TO_MAJORITY + CONSENSUS_RETRIES);
+    CHECK(result.unresolved == 1);
+
+    cartridge_buffer[0x40] = cartridge.ram[ram_base + 0x40];
+    CHECK(!memcmp(cartridge_buffer, &cartridge.ram[ram_base], Mapper::RAM_BANK_SIZE));
+
+    cartridge.clear_faults();
+}
+
+// Dropped writes have to be found and written again by the verify mode, one that never sticks is reported.
+template <typename Mapper>
+static void test_verify_written_ram(MbcCartridge& cartridge)
+{
+    const unsigned bank = cartridge.ram.size() / Mapper::RAM_BANK_SIZE - 1;
+    const unsigned base = bank * Mapper::RAM_BANK_SIZE;
+
+    verify_result result;
+
+    Mapper::reset();
+
+    // The first write of three bytes is lost and the second write of another.
+    read_ram<Mapper>(bank);
+
+    for (unsigned offset : { 0u, 0x33u, Mapper::RAM_BANK_SIZE - 1u })
+    {
+        cartridge_buffer[offset] ^= 0x01;
+        cartridge.add_ram_write_fault(base + offset, 1);
+    }
+
+    cartridge_buffer[0x80] ^= 0x01;
+    cartridge.add_ram_write_fault(base + 0x80, 2);
+
+    write_ram<Mapper>(bank);
+    verify_written_ram<Mapper>(bank, result);
+
+    CHECK(result.mismatches == 4);
+    CHECK(result.rewrites == 4 + 1);
+    CHECK(result.unresolved == 0);
+    CHECK(!memcmp(cartridge_buffer, &cartridge.ram[base], Mapper::RAM_BANK_SIZE));
+
+    // A byte that never sticks is rewritten every round and left over at the end.
+    cartridge_buffer[0x10] ^= 0x01;
+    cartridge.add_ram_write_fault(base + 0x10, MbcCartridge::FAULT_PERSISTENT);
+
+    write_ram<Mapper>(bank);
+    verify_written_ram<Mapper>(bank, result);
+
+    CHECK(result.mismatches == 1);
+    CHECK(result.rewrites == VERIFY_RETRIES);
+    CHECK(result.unresolved == 1);
+    CHECK(cartridge.ram[base + 0x10] != cartridge_buffer[0x10]);
+
+    cartridge.clear_faults();
+}
+
+static void test_cartridge(const CartridgeConfig& config)
+{
+    MbcCartridge cartridge(config.type, config.cartridge_type, config.rom_banks, config.ram_size);
+    PmodBoard board(cartridge);
+
+    host::attach_board(&board);
+    board.set_access_ticks(ns_to_ticks(config.access_ns));
+
+    CHECK(bus_init() == XST_SUCCESS);
+
+    cartridge_header* header = mbc1::read_header();
+    CHECK(!memcmp(header, &cartridge.rom[HEADER_BASE_ADDRESS], sizeof(cartridge_header)));
+
+    uint8_t cartridge_type = header->cartridge_type;
+    select_timing_profile(header);
+
+    CHECK(dispatch_rom_mapper(cartridge_type, [&](auto mapper) {
+        test_rom<decltype(mapper)>(cartridge);
+    }));
+
+    CHECK(dispatch_ram_mapper(cartridge_type, [&](auto mapper) {
+        test_ram<decltype(mapper)>(cartridge);
+        test_consensus<decltype(mapper)>(cartridge);
+        test_verify_written_ram<decltype(mapper)>(cartridge);
+    }));
+
+    CHECK(board.get_counters().protocol_errors == 0);
+    CHECK(board.get_counters().timing_violations == 0);
+
+    host::attach_board(nullptr);
+}
+
+int main()
+{
+    srand(1);
+
+    for (const CartridgeConfig& config : CARTRIDGE_CONFIGS)
+        RUN_NAMED_TEST(config.name, test_cartridge(config));
+
+    return test_summary();
+}
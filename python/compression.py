@@ -0,0 +1,88 @@
+# LZ codec for the compressed transfers, see src/compression.h for the format.
+
+BANK_RAW = 0
+BANK_COMPRESSED = 1
+
+LITERAL_RUN_MAX = 128
+MATCH_LENGTH_MIN = 3
+MATCH_LENGTH_MAX = 130
+MATCH_FLAG = 0x80
+
+
+def _emit_literals(output, data):
+    for start in range(0, len(data), LITERAL_RUN_MAX):
+        run = data[start:start + LITERAL_RUN_MAX]
+        output.append(len(run) - 1)
+        output += run
+
+
+# Returns the compressed bank or None if it does not get smaller.
+def compress(data):
+    output = bytearray()
+    last_positions = {}
+    literal_start = 0
+    position = 0
+
+    while position + MATCH_LENGTH_MIN <= len(data):
+        key = bytes(data[position:position + MATCH_LENGTH_MIN])
+        candidate = last_positions.get(key)
+        last_positions[key] = position
+
+        match_length = 0
+
+        if candidate is not None:
+            match_length_max = min(len(data) - position, MATCH_LENGTH_MAX)
+
+            while match_length < match_length_max and data[candidate + match_length] == data[position + match_length]:
+                match_length += 1
+
+        if match_length < MATCH_LENGTH_MIN:
+            position += 1
+            continue
+
+        _emit_literals(output, data[literal_start:position])
+
+        distance = position - candidate
+        output += bytes([MATCH_FLAG | (match_length - MATCH_LENGTH_MIN), distance & 0xff, distance >> 8])
+
+        for i in range(1, match_length):
+            if position + i + MATCH_LENGTH_MIN <= len(data):
+                last_positions[bytes(data[position + i:position + i + MATCH_LENGTH_MIN])] = position + i
+
+        position += match_length
+        literal_start = position
+
+    _emit_literals(output, data[literal_start:])
+
+    return bytes(output) if len(output) < len(data) else None
+
+
+def decompress(data, length):
+    output = bytearray()
+    read = 0
+
+    while read < len(data):
+        control = data[read]
+        read += 1
+
+        if not control & MATCH_FLAG:
+            count = control + 1
+            output += data[read:read + count]
+            read += count
+            continue
+
+        count = (control & ~MATCH_FLAG) + MATCH_LENGTH_MIN
+        distance = data[read] | data[read + 1] << 8
+        read += 2
+
+        if distance == 0 or distance > len(output):
+            raise ValueError("Compressed bank references data before its start.")
+
+        # Byte by byte on purpose, the match may overlap what it produces.
+        for _ in range(count):
+            output.append(output[-distance])
+
+    if len(output) != length:
+        raise ValueError(f"Compressed bank decompressed to {len(output)} instead of {length} bytes.")
+
+    return bytes(output)
@@ -1,7 +1,13 @@
 import argparse
+import hashlib
+import os
 import serial
+import struct
 import sys
 import time
+import zlib
+
+import compression
 
 from enum import Enum
 
@@ -13,12 +19,19 @@ class ResponseType(Enum):
     INVALID_NUM_ROM_BANKS   = 10
     INVALID_NUM_RAM_BANKS   = 11
     INVALID_CARTRIDGE_TYPE  = 12
+    INVALID_HEADER          = 13
+    CALIBRATION_FAILED      = 14
 
     # PC tries op that the cart cannot handle
     INVALID_RAM_WRITE_SIZE  = 21
     CARTRIDGE_HAS_NO_RAM    = 22
     CARTRIDGE_HAS_NO_RTC    = 23
     INVALID_RTC_WRITE_SIZE  = 24
+    INVALID_COMPRESSED_DATA = 25
+
+    # PC tries op that the board cannot handle
+    INVALID_ARGUMENTS       = 30
+    UNSUPPORTED_BAUD_RATE   = 31
 
 
 # We do our logging into stderr so the data can be piped from stdout to a file with the shell.
@@ -29,9 +42,26 @@ def die(message):
     log(message)
     exit(0)
 
+# Reports the duration and effective throughput of a transfer so speedups (or regressions)
+# of the bus and link can be compared between firmware versions on the same cartridge.
+def throughput(num_bytes, start):
+    duration = max(time.time() - start, 1e-6)
+    return f"({duration:.2f}s, {num_bytes / duration / 1024:.2f} KiB/s)"
+
 TRANSFER_TIMEOUT = 5
 last_comm = time.time()
 
+# Everything that goes into the dump passes through here so it can be checked against the integrity trailer.
+dump_sha1 = hashlib.sha1()
+dump_crc = 0
+
+def output(data):
+    global dump_crc
+
+    dump_sha1.update(data)
+    dump_crc = zlib.crc32(data, dump_crc)
+    return sys.stdout.buffer.write(data)
+
 # Waits until atleast n bytes are in our RX buffer.
 # Times out if last receive is more than 3 seconds ago.
 def wait_for_n_serial_bytes(count):
@@ -48,6 +78,459 @@ def wait_for_n_serial_bytes(count):
 
     last_comm = time.time()
 
+BUFFER_CHUNK_SIZE = 256 # Has to match RAM_WRITE_CHUNK_SIZE in the firmware.
+
+# Sends the buffer in chunks, it has to be divisible by BUFFER_CHUNK_SIZE. The board grants a window
+# of bytes it can buffer and acknowledges every chunk with its CRC-32, which frees one more chunk.
+def send_chunks(buffer):
+    buffer_length = len(buffer)
+    num_chunks = buffer_length // BUFFER_CHUNK_SIZE
+
+    def chunk(i):
+        return buffer[i * BUFFER_CHUNK_SIZE: (i+1) * BUFFER_CHUNK_SIZE]
+
+    wait_for_n_serial_bytes(4)
+    window = int.from_bytes(link.read(4), byteorder="little") // BUFFER_CHUNK_SIZE
+
+    chunks_sent = 0
+    chunks_acknowledged = 0
+    corrupted_chunks = 0
+
+    while chunks_acknowledged < num_chunks:
+        while chunks_sent < num_chunks and chunks_sent - chunks_acknowledged < window:
+            link.write(chunk(chunks_sent))
+            chunks_sent += 1
+
+        wait_for_n_serial_bytes(4)
+
+        # Corrupted chunks were already written, the rest is sent anyway to keep the board in sync.
+        if int.from_bytes(link.read(4), byteorder="little") != zlib.crc32(chunk(chunks_acknowledged)):
+            corrupted_chunks += 1
+
+        chunks_acknowledged += 1
+        bytes_sent = chunks_acknowledged * BUFFER_CHUNK_SIZE
+
+        if buffer_length < 1024:
+            log(f"\rSending data...{bytes_sent}B/{buffer_length}B", "")
+        else:
+            log(f"\rSending data...{bytes_sent//1024}K/{buffer_length//1024}K", "")
+
+    if corrupted_chunks:
+        die(f"\n{corrupted_chunks} chunk(s) arrived corrupted, write the RAM again.")
+
+    return buffer_length
+
+# Receives a single byte response, dies with the message if it is in errors.
+def expect_ok(errors):
+    wait_for_n_serial_bytes(1)
+    response = ResponseType(int.from_bytes(link.read(1)))
+
+    if response in errors:
+        die(errors[response])
+
+# Everything that is neither framed, compressed nor hashed is sent as it is.
+def receive_raw(bytes_to_receive, transfer_start):
+    bytes_received = 0
+
+    while bytes_received != bytes_to_receive:
+        # The contents of "help" and "parse header" may not be divisible by 64.
+        bytes_to_read = min(16, bytes_to_receive - bytes_received)
+
+        wait_for_n_serial_bytes(bytes_to_read)
+
+        bytes_received += output(link.read(bytes_to_read))
+
+        if bytes_to_receive < 1024:
+            log(f"\rReceiving data...{bytes_received}B/{bytes_to_receive}B", "")
+        else:
+            log(f"\rReceiving data...{bytes_received//1024}K/{bytes_to_receive//1024}K", "")
+
+    log(f"...done! {throughput(bytes_received, transfer_start)}")
+
+# Reads exactly count bytes, the OS buffer of the link may be smaller than a whole bank.
+def read_serial_bytes(count):
+    data = bytearray()
+
+    while len(data) != count:
+        bytes_to_read = min(64, count - len(data))
+        wait_for_n_serial_bytes(bytes_to_read)
+        data += link.read(bytes_to_read)
+
+    return bytes(data)
+
+# Receives a bank as the firmware queues it, returns it and how many bytes it took on the wire.
+# Compressed banks are sent as their encoding, their size (16 bit little endian) and the data, see src/compression.h.
+def receive_bank(bank, bank_size):
+    if not compressed:
+        return read_serial_bytes(bank_size), bank_size
+
+    wait_for_n_serial_bytes(3)
+    encoding, size = link.read(1)[0], int.from_bytes(link.read(2), byteorder="little")
+
+    data = read_serial_bytes(size)
+
+    if encoding == compression.BANK_COMPRESSED:
+        try:
+            data = compression.decompress(data, bank_size)
+        except ValueError as error:
+            die(f"Bank {bank} is corrupt: {error}")
+
+    return data, 3 + size
+
+# See __send_bank in the firmware.
+BANK_REQUEST_SEND = 0
+BANK_REQUEST_SKIP = 1
+
+# Banks the host already has in hashed mode, either from the expected image or the bank cache.
+def known_bank(bank, digest, bank_size):
+    if expected_image is not None:
+        expected_bank = expected_image[bank * bank_size:(bank + 1) * bank_size]
+
+        if hashlib.sha1(expected_bank).digest() == digest:
+            return expected_bank
+
+    if args.cache is not None:
+        path = os.path.join(args.cache, digest.hex())
+
+        if os.path.exists(path):
+            with open(path, "rb") as file:
+                return file.read()
+
+    return None
+
+# Compressed and hashed reads go bank by bank.
+def receive_banks(bytes_to_receive, bank_size, transfer_start):
+    bytes_received = 0
+    bytes_on_wire = 0
+    banks_skipped = 0
+    mismatched_banks = []
+
+    while bytes_received != bytes_to_receive:
+        bank = bytes_received // bank_size
+        bank_start = time.time()
+
+        if not hashed:
+            data, size = receive_bank(bank, bank_size)
+        else:
+            digest = read_serial_bytes(hashlib.sha1().digest_size)
+            data = known_bank(bank, digest, bank_size)
+            size = len(digest) + 1
+
+            if data is not None:
+                link.write(bytes([BANK_REQUEST_SKIP]))
+                banks_skipped += 1
+            else:
+                link.write(bytes([BANK_REQUEST_SEND]))
+                data, bank_size_on_wire = receive_bank(bank, bank_size)
+                size += bank_size_on_wire
+
+                if hashlib.sha1(data).digest() != digest:
+                    die(f"Bank {bank} was corrupted on the link.")
+
+                if args.cache is not None:
+                    with open(os.path.join(args.cache, digest.hex()), "wb") as file:
+                        file.write(data)
+
+        if expected_image is not None and data != expected_image[bank * bank_size:(bank + 1) * bank_size]:
+            mismatched_banks.append(bank)
+
+        bytes_received += output(data)
+        bytes_on_wire += size
+
+        log(f"\rBank {bank}: {len(data)}B -> {size}B ({size * 100 // len(data)}%) {throughput(len(data), bank_start)}")
+        log(f"Receiving data...{bytes_received//1024}K/{bytes_to_receive//1024}K ({bytes_on_wire * 100 // bytes_received}% on the wire)", "")
+
+    log(f"...done! {throughput(bytes_to_receive, transfer_start)}")
+
+    if hashed:
+        log(f"{banks_skipped} of {bytes_to_receive // bank_size} banks were skipped.")
+
+    if expected_image is not None:
+        if len(expected_image) != bytes_to_receive:
+            log(f"Dump is {bytes_to_receive}B but the expected image is {len(expected_image)}B.")
+        elif not mismatched_banks:
+            log("Dump matches the expected image.")
+        else:
+            die(f"Dump differs from the expected image in bank(s) {', '.join(map(str, mismatched_banks))}.")
+
+# See __queue_framed_bank in the firmware for the frame layout.
+FRAME_MAGIC = 0xf5
+FRAME_PAYLOAD_SIZE = 512
+FRAME_HEADER_SIZE = 9
+FRAME_CRC_SIZE = 4
+FRAME_SIZE = FRAME_HEADER_SIZE + FRAME_PAYLOAD_SIZE + FRAME_CRC_SIZE
+FRAME_MAX_ROUNDS = 16
+
+# The board ends a transfer it gave up on with a frame of this sequence number and no payload.
+FRAME_ABORT_SEQUENCE = 0xffff
+FRAME_ABORT_SIZE = FRAME_HEADER_SIZE + FRAME_CRC_SIZE
+
+# Once bytes are flowing, this much silence means the board sent everything of this round.
+FRAME_QUIET_TIME = 0.2
+
+# Collects what the board sends in one round, which may be more or less than expected on a bad line.
+def read_frame_round(expected_length):
+    global last_comm
+
+    data = bytearray()
+    last_comm = time.time()
+
+    while True:
+        waiting = link.in_waiting
+
+        if waiting:
+            data += link.read(waiting)
+            last_comm = time.time()
+            continue
+
+        quiet = time.time() - last_comm
+
+        if data and (quiet >= FRAME_QUIET_TIME or (len(data) >= expected_length and quiet >= 0.01)):
+            return bytes(data)
+
+        if quiet >= TRANSFER_TIMEOUT:
+            die("Transfer timed out. Exiting.")
+
+        time.sleep(0.001)
+
+def is_abort_frame(data, bank):
+    if len(data) < FRAME_ABORT_SIZE or data[0] != FRAME_MAGIC:
+        return False
+
+    if zlib.crc32(data[:FRAME_HEADER_SIZE]) != int.from_bytes(data[FRAME_HEADER_SIZE:FRAME_ABORT_SIZE], byteorder="little"):
+        return False
+
+    return struct.unpack_from("<HHHH", data, 1) == (FRAME_ABORT_SEQUENCE, bank, 0, 0)
+
+# Picks the intact frames of the bank out of the data, garbage in between is skipped.
+# Returns False if the board gave up on the transfer.
+def parse_frames(data, bank, bank_size, frames):
+    position = 0
+
+    while position + FRAME_ABORT_SIZE <= len(data):
+        if is_abort_frame(data[position:position + FRAME_ABORT_SIZE], bank):
+            return False
+
+        frame = data[position:position + FRAME_SIZE]
+
+        if len(frame) < FRAME_SIZE or frame[0] != FRAME_MAGIC \
+            or zlib.crc32(frame[:-FRAME_CRC_SIZE]) != int.from_bytes(frame[-FRAME_CRC_SIZE:], byteorder="little"):
+            position += 1
+            continue
+
+        sequence, frame_bank, offset, length = struct.unpack_from("<HHHH", frame, 1)
+
+        if frame_bank == bank and length == FRAME_PAYLOAD_SIZE and offset % FRAME_PAYLOAD_SIZE == 0 and offset < bank_size \
+            and sequence == (bank * bank_size + offset) // FRAME_PAYLOAD_SIZE:
+            frames[offset // FRAME_PAYLOAD_SIZE] = frame[FRAME_HEADER_SIZE:-FRAME_CRC_SIZE]
+
+        position += FRAME_SIZE
+
+    return True
+
+# Every bank is confirmed by the bitmap of missing frames, the bank and their CRC-32, which the board answers by resending them.
+def receive_framed_banks(bytes_to_receive, bank_size, transfer_start):
+    frames_per_bank = bank_size // FRAME_PAYLOAD_SIZE
+    frames_resent = 0
+
+    for bank in range(bytes_to_receive // bank_size):
+        frames = {}
+        missing = frames_per_bank
+
+        for round in range(FRAME_MAX_ROUNDS):
+            if not parse_frames(read_frame_round(missing * FRAME_SIZE), bank, bank_size, frames):
+                die(f"\nBoard gave up on bank {bank} after {FRAME_MAX_ROUNDS} rounds.")
+
+            bitmap = sum(1 << frame for frame in range(frames_per_bank) if frame not in frames)
+            answer = bitmap.to_bytes(4, byteorder="little") + bank.to_bytes(2, byteorder="little")
+            link.write(answer + zlib.crc32(answer).to_bytes(4, byteorder="little"))
+
+            if bitmap == 0:
+                break
+
+            missing = bitmap.bit_count()
+            frames_resent += missing
+            log(f"\rBank {bank}: asking for {missing} frame(s) again.")
+        else:
+            die(f"Bank {bank} could not be received after {FRAME_MAX_ROUNDS} rounds.")
+
+        output(b"".join(frames[frame] for frame in range(frames_per_bank)))
+
+        log(f"\rReceiving data...{(bank + 1) * bank_size // 1024}K/{bytes_to_receive // 1024}K", "")
+
+    log(f"...done! {throughput(bytes_to_receive, transfer_start)}")
+
+    if frames_resent:
+        log(f"{frames_resent} frame(s) had to be resent.")
+
+# The board sends the mismatches, retries and unresolved bytes of every bank after the data, see verify_rom in the firmware.
+def receive_consensus_report(num_banks):
+    report = read_serial_bytes(num_banks * 6)
+    total_mismatches = 0
+    total_unresolved = 0
+
+    for bank in range(num_banks):
+        mismatches, retries, unresolved = struct.unpack_from("<HHH", report, bank * 6)
+
+        if mismatches:
+            log(f"Bank {bank}: {mismatches} byte(s) differed, {retries} re-read(s), {unresolved} without majority.")
+
+        total_mismatches += mismatches
+        total_unresolved += unresolved
+
+    if total_unresolved:
+        log(f"{total_unresolved} byte(s) had no majority, clean the cartridge contacts and dump again.")
+    elif total_mismatches:
+        log(f"{total_mismatches} unstable byte(s) were settled by majority vote.")
+    else:
+        log("Every bank read the same twice.")
+
+# The board hashes what it read, so a mismatch here means the link and not the cartridge is to blame.
+def receive_integrity_report(is_rom):
+    report = read_serial_bytes(28)
+    global_sum, global_checksum, crc = struct.unpack_from("<HHI", report)
+    sha1 = report[8:]
+
+    log(f"CRC-32: {crc:08x}, SHA-1: {sha1.hex()}")
+
+    if crc != dump_crc or sha1 != dump_sha1.digest():
+        die(f"Dump rejected, it does not match what the board read (CRC-32 {dump_crc:08x}, SHA-1 {dump_sha1.hexdigest()}).")
+
+    if is_rom and global_sum != global_checksum:
+        die(f"Dump rejected, the global checksum is {global_sum:04x} but the header says {global_checksum:04x}.")
+
+    log("Dump accepted.")
+
+def receive_verify_report(num_banks):
+    report = read_serial_bytes(num_banks * 6)
+    total_mismatches = 0
+    total_unresolved = 0
+
+    for bank in range(num_banks):
+        mismatches, rewrites, unresolved = struct.unpack_from("<HHH", report, bank * 6)
+
+        if mismatches:
+            log(f"Bank {bank}: {mismatches} byte(s) did not stick, {rewrites} rewrite(s), {unresolved} still wrong.")
+
+        total_mismatches += mismatches
+        total_unresolved += unresolved
+
+    if total_unresolved:
+        die(f"{total_unresolved} byte(s) could not be written, check the contacts and the battery of the cartridge.")
+    elif total_mismatches:
+        log(f"{total_mismatches} byte(s) were written again and verified.")
+    else:
+        log("Every bank read back as written.")
+
+# Compresses every bank that gets smaller and pads the stream to whole chunks.
+def compress_banks(buffer, bank_size):
+    stream = bytearray()
+
+    for start in range(0, len(buffer), bank_size):
+        bank = buffer[start:start + bank_size]
+        data = compression.compress(bank)
+
+        if data is None:
+            stream += bytes([compression.BANK_RAW]) + len(bank).to_bytes(2, byteorder="little") + bank
+            log(f"Bank {start // bank_size}: {len(bank)}B sent raw")
+        else:
+            stream += bytes([compression.BANK_COMPRESSED]) + len(data).to_bytes(2, byteorder="little") + data
+            log(f"Bank {start // bank_size}: {len(bank)}B -> {len(data)}B ({len(data) * 100 // len(bank)}%)")
+
+    stream += bytes(-len(stream) % BUFFER_CHUNK_SIZE)
+    return bytes(stream)
+
+# See cli_baud in the firmware for the handshake.
+DEFAULT_BAUDRATE = 115200
+BAUD_HANDSHAKE_REQUEST = 0xa5
+BAUD_HANDSHAKE_ACK = 0x5a
+BAUD_HANDSHAKE_CONFIRM = 0xc3
+BAUD_HANDSHAKE_TIMEOUT = 1
+
+# Tried from the top by --fast, the PS UART of the PYNQ-Z2 takes all of them
+# (as long as the USB-UART does), the UartLite of the Basys3 rejects them.
+FAST_BAUDRATES = [3000000, 2000000, 1500000, 1000000, 921600, 460800, 230400]
+
+# Switches board and host to the given baudrate. Returns False if the board rejected it
+# or the handshake failed, in which case both ends fall back to the default baudrate.
+def switch_baudrate(baudrate):
+    global link
+
+    link.reset_input_buffer()
+    link.write(f"baud {baudrate}\r".encode("ascii"))
+    link.timeout = BAUD_HANDSHAKE_TIMEOUT
+
+    try:
+        response = link.read(1)
+        if response != bytes([ResponseType.OK.value]):
+            return False
+
+        link.baudrate = baudrate
+        time.sleep(0.05)
+        link.reset_input_buffer()
+
+        link.write(bytes([BAUD_HANDSHAKE_REQUEST]))
+        if link.read(1) == bytes([BAUD_HANDSHAKE_ACK]):
+            link.write(bytes([BAUD_HANDSHAKE_CONFIRM]))
+            link.flush()
+            return True
+
+        # Give the board time to notice and fall back as well.
+        link.baudrate = DEFAULT_BAUDRATE
+        time.sleep(2 * BAUD_HANDSHAKE_TIMEOUT)
+        link.reset_input_buffer()
+        return False
+
+    finally:
+        link.timeout = None
+
+# Finds the fastest baudrate the board and the link handle, returns the one in use afterwards.
+def probe_baudrate():
+    for baudrate in FAST_BAUDRATES:
+        if baudrate <= link.baudrate:
+            break
+
+        log(f"Trying {baudrate} baud...", "")
+
+        if switch_baudrate(baudrate):
+            log("ok!")
+            break
+
+        log("failed.")
+
+    return link.baudrate
+
+
+# Binary requests, see src/cli_handlers.h. The parameters are the same text as in ASCII mode.
+REQUEST_MAGIC = 0xb5
+RESPONSE_MAGIC = 0xb6
+
+OPCODES = {
+    "help":             0x01,
+    "parse header":     0x02,
+    "read rom":         0x03,
+    "read ram":         0x04,
+    "write ram":        0x05,
+    "read range":       0x06,
+    "burst on":         0x07,
+    "burst off":        0x08,
+    "calibrate":        0x09,
+    "baud":             0x0a,
+    "stats":            0x40,
+    "capture header":   0x41,
+    "capture bank":     0x42,
+}
+
+def encode_request(command, request_id):
+    names = [name for name in OPCODES if command == name or command.startswith(name + " ")]
+    if not names:
+        die(f"Command \"{command}\" has no opcode.")
+
+    name = max(names, key=len)
+    parameters = command[len(name) + 1:].encode("ascii")
+
+    return bytes([REQUEST_MAGIC, OPCODES[name]]) + request_id.to_bytes(2, byteorder="little") + bytes([len(parameters)]) + parameters
+
 
 parser = argparse.ArgumentParser(
     prog="reader",
@@ -58,6 +541,10 @@ parser = argparse.ArgumentParser(
 )
 parser.add_argument("-p", "--port", type=str, required=True, help="Serial port the board is connected to")
 parser.add_argument("-b", "--baudrate", type=int, required=True, default=115200, help="Baudrate of the connection (default: 115200)")
+parser.add_argument("-f", "--fast", action="store_true", help="Switch to the fastest baudrate the board supports for this command")
+parser.add_argument("--binary", action="store_true", help="Send the command as a binary request instead of an ASCII line")
+parser.add_argument("--cache", type=str, help="Bank cache directory for hashed reads, known banks are not sent again")
+parser.add_argument("--expect", type=str, help="Image to verify a hashed read against, matching banks are not sent")
 parser.add_argument("command", nargs=argparse.REMAINDER, help="Command to send (show header, read rom, help, ...)")
 
 args = parser.parse_args(args=None if sys.argv[1:] else ["--help"])
@@ -66,13 +553,83 @@ if len(args.command) == 0:
     print("No command was passed. Exiting.")
     exit(0)
 
+# The cache and the expected image only pay off if the board sends the digests first.
+if (args.cache is not None or args.expect is not None) and args.command[:2] in (["read", "rom"], ["read", "ram"]) and "hashed" not in args.command:
+    args.command.append("hashed")
+
 command = " ".join(args.command)
+compressed = "compressed" in args.command
+hashed = "hashed" in args.command
+framed = "framed" in args.command
+consensus = "consensus" in args.command
+integrity = "integrity" in args.command
+delta = "delta" in args.command
+verify = "verify" in args.command
 
-with serial.Serial(args.port, args.baudrate, bytesize=8, parity="N", stopbits=1) as link:
+# Have to match the line buffer in main.cpp and MAX_RANGE_REGIONS in the firmware,
+# the board rejects longer lines and more regions with INVALID_ARGUMENTS.
+MAX_COMMAND_LENGTH = 223
+MAX_RANGE_REGIONS = 8
+
+# Catches what the board would reject before anything is sent, returns the total length of the regions.
+def check_range_regions(arguments):
+    words = arguments.split()
+
+    if len(words) == 0 or len(words) % 4 != 0:
+        die("read range takes regions of <rom|ram> <bank> <offset> <length>.")
+
+    if len(words) // 4 > MAX_RANGE_REGIONS:
+        die(f"read range takes at most {MAX_RANGE_REGIONS} regions, split the request.")
+
+    total_length = 0
+
+    for i in range(0, len(words), 4):
+        space, bank, offset, length = words[i:i + 4]
+
+        try:
+            bank, offset, length = int(bank, 0), int(offset, 0), int(length, 0)
+        except ValueError:
+            die(f"Region {i // 4} has a number that is not decimal or 0x hex.")
+
+        if space not in ("rom", "ram") or length == 0 or offset + length > 0x4000:
+            die(f"Region {i // 4} has to be <rom|ram> <bank> <offset> <length> inside a single bank.")
+
+        total_length += length
+
+    return total_length
+
+if len(command) > MAX_COMMAND_LENGTH:
+    die(f"Command is longer than the {MAX_COMMAND_LENGTH} characters the board accepts.")
+
+if command.startswith("read range"):
+    log(f"Requesting {check_range_regions(command[len('read range'):])}B in {len(args.command[2:]) // 4} region(s).")
+
+expected_image = None
+if args.expect is not None:
+    with open(args.expect, "rb") as file:
+        expected_image = file.read()
+
+if args.cache is not None:
+    os.makedirs(args.cache, exist_ok=True)
+
+# Sends the command and handles the response, expects the link to be open.
+def run_command():
+    global last_comm
 
     log(f"Sending command: {command}")
-    link.write((command + "\r").encode("ascii"))
-    last_comm = time.time()
+
+    if args.binary:
+        request_id = int(time.time()) & 0xffff
+        link.write(encode_request(command, request_id))
+        last_comm = time.time()
+
+        wait_for_n_serial_bytes(3)
+
+        if link.read(3) != bytes([RESPONSE_MAGIC]) + request_id.to_bytes(2, byteorder="little"):
+            die("Response does not belong to the request.")
+    else:
+        link.write((command + "\r").encode("ascii"))
+        last_comm = time.time()
 
     wait_for_n_serial_bytes(1)
 
@@ -98,32 +655,42 @@ with serial.Serial(args.port, args.baudrate, bytesize=8, parity="N", stopbits=1)
             case ResponseType.INVALID_CARTRIDGE_TYPE:
                 die("Cartridge type not recognized. Broken cartridge/Bad connection?")
 
+            case ResponseType.INVALID_HEADER:
+                die("Cartridge header is invalid. Broken cartridge/Bad connection?")
+
+            case ResponseType.CALIBRATION_FAILED:
+                die("No reliable bus timing found. Broken cartridge/Bad connection?")
+
+            case ResponseType.INVALID_ARGUMENTS:
+                die("Invalid arguments for this command. Try \"help\" for command reference.")
+
     except ValueError:
         die(f"Invalid response type: {response}")
 
 
-    if (command == "help") or ("parse header" == command) or ("read" in command):
+    if (command == "help") or ("parse header" == command) or ("read" in command) or ("capture" in command) or (command == "calibrate"):
         log("Receiving data...", "")
+        transfer_start = time.time()
 
         wait_for_n_serial_bytes(4)
 
-        bytes_received = 0
         bytes_to_receive = int.from_bytes(link.read(4), byteorder="little")
 
-        while bytes_received != bytes_to_receive:
-            # The contents of "help" and "parse header" may not be divisible by 64.
-            bytes_to_read = min(16, bytes_to_receive - bytes_received)
-
-            wait_for_n_serial_bytes(bytes_to_read)
+        # MBC2 RAM is a single bank of 512 bytes.
+        bank_size = 0x4000 if "rom" in command else min(0x2000, bytes_to_receive)
 
-            bytes_received += sys.stdout.buffer.write(link.read(bytes_to_read))
+        if framed:
+            receive_framed_banks(bytes_to_receive, bank_size, transfer_start)
+        elif compressed or hashed:
+            receive_banks(bytes_to_receive, bank_size, transfer_start)
+        else:
+            receive_raw(bytes_to_receive, transfer_start)
 
-            if bytes_to_receive < 1024:
-                log(f"\rReceiving data...{bytes_received}B/{bytes_to_receive}B", "")
-            else:
-                log(f"\rReceiving data...{bytes_received//1024}K/{bytes_to_receive//1024}K", "")
+        if consensus:
+            receive_consensus_report(bytes_to_receive // bank_size)
 
-        log("...done!")
+        if integrity:
+            receive_integrity_report("rom" in command)
 
     elif "write" in command:
         log("Sending size...", "")
@@ -148,23 +715,51 @@ with serial.Serial(args.port, args.baudrate, bytesize=8, parity="N", stopbits=1)
             case ResponseType.INVALID_RTC_WRITE_SIZE:
                 die("RTC write size does not match cartridge RTC size.")
 
+        if compressed:
+            # MBC2 RAM is a single bank of 512 bytes.
+            stream = compress_banks(buffer, min(0x2000, buffer_length))
+            log(f"Compressed {buffer_length}B to {len(stream)}B.")
+
+            link.write(len(stream).to_bytes(4, byteorder="little"))
+            expect_ok({ResponseType.INVALID_RAM_WRITE_SIZE: "Compressed stream is larger than the cartridge RAM."})
+
+            buffer = stream
+
         log("Sending data...", "")
+        transfer_start = time.time()
 
-        RAM_BANK_SIZE = 0x2000
-        BUFFER_CHUNK_SIZE = 16 # Zynq has a RX buffer of 64 bytes but Basys3 UartLite only 16 bytes!
-        bytes_sent = 0
+        bytes_sent = send_chunks(buffer)
 
-        for i in range(buffer_length // BUFFER_CHUNK_SIZE):
-            bytes_sent += link.write(buffer[i * BUFFER_CHUNK_SIZE: (i+1) * BUFFER_CHUNK_SIZE])
+        if compressed:
+            expect_ok({ResponseType.INVALID_COMPRESSED_DATA: "\nBoard rejected the compressed data, the RAM was not written completely."})
 
-            wait_for_n_serial_bytes(BUFFER_CHUNK_SIZE)
-            link.read(BUFFER_CHUNK_SIZE)
+        log(f"...done! {throughput(bytes_sent, transfer_start)}")
 
-            if buffer_length < 1024:
-                log(f"\rSending data...{bytes_sent}B/{buffer_length}B", "")
-            else:
-                log(f"\rSending data...{bytes_sent//1024}K/{buffer_length//1024}K", "")
+        if delta:
+            bytes_written = int.from_bytes(read_serial_bytes(4), byteorder="little")
+            log(f"{bytes_written} of {buffer_length} bytes differed and were written.")
+
+        if verify:
+            # MBC2 RAM is a single bank of 512 bytes.
+            receive_verify_report(buffer_length // min(0x2000, buffer_length))
+
+
+with serial.Serial(args.port, args.baudrate, bytesize=8, parity="N", stopbits=1) as link:
+
+    if command.startswith("baud "):
+        if switch_baudrate(int(command[5:])):
+            die(f"Board switched to {link.baudrate} baud, pass -b {link.baudrate} from now on.")
+
+        die("Board did not switch the baudrate, it stays at the default.")
 
-        log("...done!")
+    if args.fast:
+        log(f"Running at {probe_baudrate()} baud.")
+
+    try:
+        run_command()
+    finally:
+        # Leave the board at the rate the next invocation expects.
+        if link.baudrate != args.baudrate:
+            switch_baudrate(args.baudrate)
 
 exit(0)
@@ -0,0 +1,103 @@
+import argparse
+import struct
+import sys
+
+# Converts a PMOD capture (output of "reader.py ... capture header/bank") into a
+# Value Change Dump which can be opened with GTKWave, PulseView, Surfer, etc.
+
+# Bit positions of the PMOD lines, see PmodSignals in src/pmod.h.
+SIGNALS = [
+    "RDn",
+    "CSn",
+    "ADDR_SDATA",
+    "ADDR_RCLK",
+    "WRn",
+    "ADDR_SCLK",
+    "DATA_OUT_SDATA",
+    "DATA_OUT_RCLK",
+    "DATA_IN_SDATA",
+    "DATA_IN_RCLK",
+    "DATA_OUT_OEn",
+    "DATA_OUT_SCLK",
+    "DATA_IN_PLn",
+    "DATA_IN_SCLK",
+]
+
+DATA_IN_SDATA = SIGNALS.index("DATA_IN_SDATA")
+
+CAPTURE_WRITE = 0
+CAPTURE_READ = 1
+
+RECORD_FORMAT = "<IHBx"
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+
+parser = argparse.ArgumentParser(
+    prog="vcd",
+    description="Converts a PMOD capture of the ZYNQ GBCartReader into a VCD file."
+)
+parser.add_argument("capture", type=str, help="Capture file received with reader.py")
+parser.add_argument("-o", "--output", type=str, default=None, help="VCD file to write (default: stdout)")
+
+args = parser.parse_args()
+
+with open(args.capture, "rb") as file:
+    data = file.read()
+
+HEADER_FORMAT = "<III"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+ticks_per_us, num_records, dropped_records = struct.unpack_from(HEADER_FORMAT, data, 0)
+
+if len(data) != HEADER_SIZE + num_records * RECORD_SIZE:
+    print(f"Capture is truncated, expected {num_records} records.", file=sys.stderr)
+    exit(0)
+
+# The device stops recording once its buffer is full, the waveform ends early then.
+if dropped_records:
+    print(f"Warning: The capture buffer overflowed, {dropped_records} records after the "
+          f"first {num_records} were dropped.", file=sys.stderr)
+
+output = open(args.output, "w") if args.output else sys.stdout
+
+output.write("$timescale 1ns $end\n")
+output.write("$scope module pmod $end\n")
+for index, name in enumerate(SIGNALS):
+    output.write(f"$var wire 1 {chr(ord('!') + index)} {name} $end\n")
+output.write("$upscope $end\n")
+output.write("$enddefinitions $end\n")
+
+state = [None] * len(SIGNALS)
+first_timestamp = None
+elapsed_ticks = 0
+last_timestamp = 0
+
+for i in range(num_records):
+    timestamp, value, kind = struct.unpack_from(RECORD_FORMAT, data, HEADER_SIZE + i * RECORD_SIZE)
+
+    # The timer is only 32 bits wide on the device, so accumulate the deltas.
+    if first_timestamp is None:
+        first_timestamp = last_timestamp = timestamp
+
+    elapsed_ticks += (timestamp - last_timestamp) & 0xffffffff
+    last_timestamp = timestamp
+
+    # Writes carry the outputs, reads only carry a meaningful DATA_IN_SDATA.
+    if kind == CAPTURE_WRITE:
+        bits = [index for index in range(len(SIGNALS)) if index != DATA_IN_SDATA]
+    else:
+        bits = [DATA_IN_SDATA]
+
+    changes = []
+    for index in bits:
+        bit = (value >> index) & 1
+        if state[index] != bit:
+            state[index] = bit
+            changes.append(f"{bit}{chr(ord('!') + index)}")
+
+    if changes:
+        output.write(f"#{elapsed_ticks * 1000 // ticks_per_us}\n")
+        output.write("\n".join(changes) + "\n")
+
+if output is not sys.stdout:
+    output.close()
@@ -0,0 +1,239 @@
+#include "bus.h"
+
+#include "pmod.h"
+#include "timing.h"
+#include "stats.h"
+#include "uart.h"
+
+#include <array>
+
+bool bus_burst_reads = true;
+
+/*
+    NOTE: A polled UART is serviced every UART_PUMP_INTERVAL bytes of a bus access. Each byte
+          takes several microseconds, so the 16 byte FIFO of the UartLite is still emptied
+          and refilled long before it runs over or dry, even at 921600 baud.
+*/
+const uint16_t UART_PUMP_INTERVAL = 8;
+
+/*
+    The shift routines clock every bit into the 74HC595/165 with a falling and a rising
+    edge of the shift clock. Instead of assembling each GPIO word bit by bit at runtime,
+    the edges for every possible byte are generated at compile time and streamed out
+    by write_pmod_waveform(). Each byte takes exactly 16 words regardless of its value.
+
+    NOTE: The tables take 24 KiB, which the MicroBlaze-V cannot spare next to the two bank
+          buffers in its 128 KiB of BRAM. It generates the waveform of each byte when it
+          is shifted instead, its AXI GPIO writes take longer than that anyway.
+*/
+const unsigned WAVEFORM_LENGTH = 16;
+
+struct ShiftWaveform
+{
+    uint16_t words[WAVEFORM_LENGTH];
+};
+
+template <uint16_t CLOCK_MASK, PmodSignals SDATA>
+constexpr ShiftWaveform _generate_waveform(uint8_t byte)
+{
+    ShiftWaveform waveform = {};
+
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        const uint16_t data_bit = ((byte >> (7-i)) & 0b1) << SDATA;
+
+        waveform.words[2*i] = data_bit;
+        waveform.words[2*i + 1] = data_bit | CLOCK_MASK;
+    }
+
+    return waveform;
+}
+
+const uint16_t ADDR_SHIFT_MASK = (1 << PmodSignals::ADDR_SCLK) | (1 << PmodSignals::ADDR_SDATA);
+const uint16_t DATA_OUT_SHIFT_MASK = (1 << PmodSignals::DATA_OUT_SCLK) | (1 << PmodSignals::DATA_OUT_SDATA);
+const uint16_t DATA_IN_SHIFT_MASK = 1 << PmodSignals::DATA_IN_SCLK;
+
+const uint16_t ADDR_CLOCK_MASK = 1 << PmodSignals::ADDR_SCLK;
+const uint16_t DATA_OUT_CLOCK_MASK = 1 << PmodSignals::DATA_OUT_SCLK;
+
+// The address and the data-in chain use disjoint pins, so the data-in clock can ride along
+// with the first eight address clocks (see bus_read).
+const uint16_t ADDR_DATA_IN_CLOCK_MASK = ADDR_CLOCK_MASK | DATA_IN_SHIFT_MASK;
+
+#ifdef __riscv
+template <uint16_t CLOCK_MASK, PmodSignals SDATA>
+static inline ShiftWaveform _waveform(uint8_t byte)
+{
+    return _generate_waveform<CLOCK_MASK, SDATA>(byte);
+}
+#else
+template <uint16_t CLOCK_MASK, PmodSignals SDATA>
+constexpr std::array<ShiftWaveform, 256> _generate_waveform_table()
+{
+    std::array<ShiftWaveform, 256> table = {};
+
+    for (unsigned byte = 0; byte < 256; ++byte)
+        table[byte] = _generate_waveform<CLOCK_MASK, SDATA>(byte);
+
+    return table;
+}
+
+template <uint16_t CLOCK_MASK, PmodSignals SDATA>
+constexpr std::array<ShiftWaveform, 256> WAVEFORM_TABLE = _generate_waveform_table<CLOCK_MASK, SDATA>();
+
+template <uint16_t CLOCK_MASK, PmodSignals SDATA>
+static inline const ShiftWaveform& _waveform(uint8_t byte)
+{
+    return WAVEFORM_TABLE<CLOCK_MASK, SDATA>[byte];
+}
+#endif
+
+static inline decltype(auto) _addr_waveform(uint8_t byte)
+{
+    return _waveform<ADDR_CLOCK_MASK, PmodSignals::ADDR_SDATA>(byte);
+}
+
+static inline decltype(auto) _data_out_waveform(uint8_t byte)
+{
+    return _waveform<DATA_OUT_CLOCK_MASK, PmodSignals::DATA_OUT_SDATA>(byte);
+}
+
+static inline decltype(auto) _addr_data_in_waveform(uint8_t byte)
+{
+    return _waveform<ADDR_DATA_IN_CLOCK_MASK, PmodSignals::ADDR_SDATA>(byte);
+}
+
+// Shifting data in does not depend on any data, it is a single clock pulse per bit.
+constexpr uint16_t DATA_IN_WAVEFORM[WAVEFORM_LENGTH] = {
+    0, DATA_IN_SHIFT_MASK, 0, DATA_IN_SHIFT_MASK, 0, DATA_IN_SHIFT_MASK, 0, DATA_IN_SHIFT_MASK,
+    0, DATA_IN_SHIFT_MASK, 0, DATA_IN_SHIFT_MASK, 0, DATA_IN_SHIFT_MASK, 0, DATA_IN_SHIFT_MASK
+};
+
+void _shiftout_address(uint16_t address)
+{
+    pmod_state.ADDR_RCLK = 0;
+
+    write_pmod_waveform(_addr_waveform(address >> 8).words, WAVEFORM_LENGTH, ADDR_SHIFT_MASK);
+    write_pmod_waveform(_addr_waveform(address & 0xff).words, WAVEFORM_LENGTH, ADDR_SHIFT_MASK);
+
+    pmod_state.ADDR_RCLK = 1;
+    write_pmod(BusPhase::REGISTER_LATCH);
+}
+
+void _shiftout_data(uint8_t data)
+{
+    pmod_state.DATA_OUT_RCLK = 0;
+
+    write_pmod_waveform(_data_out_waveform(data).words, WAVEFORM_LENGTH, DATA_OUT_SHIFT_MASK);
+
+    pmod_state.DATA_OUT_RCLK = 1;
+    write_pmod(BusPhase::REGISTER_LATCH);
+
+    pmod_state.DATA_OUT_OEn = 0;
+    pmod_state.WRn = 0;
+    write_pmod(BusPhase::STROBE_SETUP);
+
+    pmod_state.DATA_OUT_OEn = 1;
+    pmod_state.WRn = 1;
+    write_pmod(BusPhase::STROBE_HOLD);
+}
+
+/*
+    Reads count bytes starting at base_address into destination with the address shift of
+    byte N+1 merged into the data shift of byte N. The 74HC595 only presents a new address
+    on ADDR_RCLK, so the next address can be shifted in while the 74HC165 still shifts out
+    the byte it loaded from the current one. RDn (and CSn for RAM) are either strobed
+    around the parallel load of every byte or held for the whole range (bus_burst_reads).
+*/
+void bus_read(uint16_t base_address, uint8_t* destination, uint16_t count, bool chip_select)
+{
+    const uint16_t SHIFT_MASK = ADDR_SHIFT_MASK | DATA_IN_SHIFT_MASK;
+
+    const bool burst = bus_burst_reads;
+
+    _shiftout_address(base_address);
+
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        // Keep the UART busy with whatever was queued while the cartridge is being read.
+        if (i % UART_PUMP_INTERVAL == 0)
+            Uart_Pump();
+
+        // In burst mode this only changes anything for the first byte.
+        pmod_state.RDn = 0;
+        pmod_state.CSn = !chip_select;
+        pmod_state.DATA_IN_RCLK = 0;
+        write_pmod(BusPhase::STROBE_SETUP);
+
+        pmod_state.DATA_IN_RCLK = 1;
+        pmod_state.DATA_IN_PLn = 0;
+        write_pmod(BusPhase::PARALLEL_LOAD);
+
+        pmod_state.DATA_IN_PLn = 1;
+        write_pmod(BusPhase::PARALLEL_LOAD);
+
+        if (!burst || i + 1 == count)
+        {
+            pmod_state.CSn = 1;
+            pmod_state.RDn = 1;
+            write_pmod(BusPhase::STROBE_HOLD);
+        }
+
+        if (i + 1 == count)
+        {
+            destination[i] = shift_pmod_waveform(DATA_IN_WAVEFORM, WAVEFORM_LENGTH, DATA_IN_SHIFT_MASK);
+            break;
+        }
+
+        const uint16_t next_address = base_address + i + 1;
+
+        pmod_state.ADDR_RCLK = 0;
+        destination[i] = shift_pmod_waveform(_addr_data_in_waveform(next_address >> 8).words, WAVEFORM_LENGTH, SHIFT_MASK);
+        write_pmod_waveform(_addr_waveform(next_address & 0xff).words, WAVEFORM_LENGTH, ADDR_SHIFT_MASK);
+
+        pmod_state.ADDR_RCLK = 1;
+        write_pmod(BusPhase::REGISTER_LATCH);
+    }
+}
+
+int bus_init()
+{
+    return init_pmod();
+}
+
+void bus_reset()
+{
+    reset_pmod();
+}
+
+void bus_write_register(uint16_t register_address, uint8_t value)
+{
+    STATS_PHASE_BEGIN(PHASE_BANK_SWITCH);
+    STATS_ADD(register_writes, 1);
+
+    _shiftout_address(register_address);
+    _shiftout_data(value);
+
+    STATS_PHASE_END(PHASE_BANK_SWITCH);
+}
+
+// Writes count bytes starting at base_address into the cartridge RAM (CSn is strobed for every byte).
+void bus_write(uint16_t base_address, const uint8_t* source, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; ++i)
+    {
+        // Picks up what the PC sends ahead while the previous RAM bank is being written.
+        if (i % UART_PUMP_INTERVAL == 0)
+            Uart_Pump();
+
+        _shiftout_address(base_address + i);
+
+        pmod_state.CSn = 0;
+        write_pmod(BusPhase::STROBE_SETUP);
+
+        _shiftout_data(source[i]);
+
+        pmod_state.CSn = 1;
+        write_pmod(BusPhase::STROBE_HOLD);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    Command interface to the cartridge bus. The mapper routines only ever ask for
+    these operations, how they end up on the cartridge pins is up to the backend.
+    For now that is bit-banging the PMOD GPIO (see bus.cpp).
+*/
+
+/*
+    In burst mode bus_read() asserts RDn (and CSn) once for the whole range and only
+    re-latches the address between bytes, which the asynchronous ROM/SRAM is fine with.
+    Cartridges that misbehave can be read with the strobes toggled for every byte.
+*/
+extern bool bus_burst_reads;
+
+int bus_init();
+void bus_reset();
+void bus_write_register(uint16_t register_address, uint8_t value);
+void bus_read(uint16_t base_address, uint8_t* destination, uint16_t count, bool chip_select);
+void bus_write(uint16_t base_address, const uint8_t* source, uint16_t count);
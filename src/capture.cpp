@@ -0,0 +1,22 @@
+#include "capture.h"
+
+#ifdef CAPTURE
+
+bool capture_armed = false;
+uint32_t capture_index = 0;
+uint32_t capture_dropped = 0;
+CaptureRecord capture_buffer[CAPTURE_BUFFER_SIZE];
+
+void capture_arm()
+{
+    capture_index = 0;
+    capture_dropped = 0;
+    capture_armed = true;
+}
+
+void capture_disarm()
+{
+    capture_armed = false;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+#include "timing.h"
+
+/*
+    On-device logic analyzer for the PMOD lines. Define CAPTURE in the application's
+    UserConfig.cmake to compile it in. Once armed, every GPIO write and read is recorded
+    with a timestamp into a buffer which the capture command streams to the host afterwards.
+    python/vcd.py converts it to VCD. Records that do not fit anymore are dropped and only
+    counted, so a capture always starts where it was armed.
+
+    Recording only costs a timer read and a few stores so the captured timing
+    is close to the one without capturing.
+*/
+enum CaptureKind: uint8_t
+{
+    CAPTURE_WRITE = 0,
+    CAPTURE_READ = 1
+};
+
+struct CaptureRecord
+{
+    uint32_t timestamp;
+    uint16_t value;
+    uint8_t kind;
+    uint8_t reserved;
+} __attribute__((packed));
+
+// The PYNQ-Z2 has plenty of DDR, the MicroBlaze-V has to make do with its BRAM.
+#ifdef __riscv
+const uint32_t CAPTURE_BUFFER_SIZE = 1 << 11;
+#else
+const uint32_t CAPTURE_BUFFER_SIZE = 1 << 18;
+#endif
+
+#ifdef CAPTURE
+
+extern bool capture_armed;
+extern uint32_t capture_index;
+extern uint32_t capture_dropped;
+extern CaptureRecord capture_buffer[CAPTURE_BUFFER_SIZE];
+
+inline void capture_record(CaptureKind kind, uint16_t value)
+{
+    if (capture_index == CAPTURE_BUFFER_SIZE)
+    {
+        capture_dropped++;
+        return;
+    }
+
+    CaptureRecord& record = capture_buffer[capture_index++];
+    record.timestamp = get_timer_ticks();
+    record.value = value;
+    record.kind = kind;
+}
+
+void capture_arm();
+void capture_disarm();
+
+#define CAPTURE_RECORD(kind, value) do { if (capture_armed) capture_record(CaptureKind::kind, value); } while (0)
+
+#else
+
+#define CAPTURE_RECORD(kind, value) ((void)0)
+
+#endif
@@ -1,101 +1,92 @@
 #include "cartridge.h"
 
+#include <string.h>
+
 #include "print.h"
-#include "pmod.h"
+#include "misc.h"
+#include "bus.h"
+#include "timing.h"
+#include "stats.h"
 
 const uint16_t ROM_BANK_AREA1_BASE_ADDRESS = 0x0000;
 const uint16_t ROM_BANK_AREA2_BASE_ADDRESS = 0x4000;
 const uint16_t RAM_BANK_RTC_BASE_ADDRESS = 0xa000;
 
-uint8_t cartridge_buffer[0x4000];
+static uint8_t cartridge_buffers[2][ROM_BANK_SIZE];
+static uint8_t spare_cartridge_buffer[SPARE_CARTRIDGE_BUFFER_SIZE];
+uint8_t* cartridge_buffer = cartridge_buffers[0];
 
-/*
-    NOTE: The read/write routines could potentially be sped up by pipelining
-    some of the IO assignments. For now it's better to keep them clear
-    and separated which also aids debugging.
-*/
+// The MicroBlaze-V has 128 KiB of BRAM for code, stack and all data, the buffers may take half of it.
+#ifdef __riscv
+static_assert(sizeof(cartridge_buffers) + sizeof(spare_cartridge_buffer) <= 64 * 1024,
+              "The cartridge buffers do not fit the BRAM of the MicroBlaze-V.");
+#endif
 
-void _shiftout_address(uint16_t address)
+void swap_cartridge_buffers()
 {
-    pmod_state.ADDR_RCLK = 0;
-
-    for (unsigned i = 0; i < 16; ++i)
-    {
-        pmod_state.ADDR_SCLK = 0;
-        pmod_state.ADDR_SDATA = (address >> (15-i)) & 0b1;
-        write_pmod();
-
-        pmod_state.ADDR_SCLK = 1;
-        write_pmod();
-    }
-
-    pmod_state.ADDR_RCLK = 1;
-    write_pmod();
+    if (cartridge_buffer == cartridge_buffers[0])
+        cartridge_buffer = cartridge_buffers[1];
+    else
+        cartridge_buffer = cartridge_buffers[0];
 }
 
-void _shiftout_data(uint8_t data)
+uint8_t* get_other_cartridge_buffer()
 {
-    pmod_state.DATA_OUT_RCLK = 0;
-
-    for (unsigned i = 0; i < 8; ++i)
-    {
-        pmod_state.DATA_OUT_SCLK = 0;
-        pmod_state.DATA_OUT_SDATA = (data >> (7-i)) & 0b1;
-        write_pmod();
-
-        pmod_state.DATA_OUT_SCLK = 1;
-        write_pmod();
-    }
-
-    pmod_state.DATA_OUT_RCLK = 1;
-    write_pmod();
-
-    pmod_state.DATA_OUT_OEn = 0;
-    pmod_state.WRn = 0;
-    write_pmod();
+    return cartridge_buffer == cartridge_buffers[0] ? cartridge_buffers[1] : cartridge_buffers[0];
+}
 
-    pmod_state.DATA_OUT_OEn = 1;
-    pmod_state.WRn = 1;
-    write_pmod();
+uint8_t* get_spare_cartridge_buffer()
+{
+    return spare_cartridge_buffer;
 }
 
-uint8_t _shiftin_data()
+/*
+    NOTE: The mapper registers are write-only, so the last value written to each of them
+          is remembered and writes that would not change anything are skipped.
+          The cache is only valid for the register addresses of one mapper since other
+          addresses may alias the same register. That is why it is cleared by every
+          mapper::reset(), which happens once at the start of a command (or after an error)
+          instead of before every bank.
+*/
+struct register_state
 {
-    pmod_state.DATA_IN_RCLK = 0;
-    write_pmod();
+    uint16_t address;
+    uint8_t value;
+};
 
-    pmod_state.DATA_IN_RCLK = 1;
-    pmod_state.DATA_IN_PLn = 0;
-    write_pmod();
+static register_state register_states[4];
+static uint8_t num_register_states = 0;
 
-    pmod_state.DATA_IN_PLn = 1;
-    write_pmod();
+static void _clear_register_states()
+{
+    num_register_states = 0;
+}
 
-    uint8_t byte = 0;
-    for (unsigned i = 0; i < 8; ++i)
+static void _write_register(uint16_t address, uint8_t value)
+{
+    for (uint8_t i = 0; i < num_register_states; ++i)
     {
-        read_pmod();
-        byte |= pmod_state.DATA_IN_SDATA << (7-i);
+        if (register_states[i].address != address)
+            continue;
 
-        pmod_state.DATA_IN_SCLK = 0;
-        write_pmod();
+        if (register_states[i].value == value)
+        {
+            STATS_ADD(register_writes_elided, 1);
+            return;
+        }
 
-        pmod_state.DATA_IN_SCLK = 1;
-        write_pmod();
+        register_states[i].value = value;
+        bus_write_register(address, value);
+        return;
     }
 
-    return byte;
-}
+    if (num_register_states < arraysizeof(register_states))
+        register_states[num_register_states++] = { address, value };
 
-void _write_register(uint16_t register_address, uint8_t value)
-{
-    _shiftout_address(register_address);
-    _shiftout_data(value);
+    bus_write_register(address, value);
 }
 
-// NOTE: The cartridge and pmod_state are REQUIRED to be reset to a known state before operating on them.
-/* NOTE: Some functions like write_ram are identical across multiple MBCs.  Since their
-         footprint is rather small, they are deliberately left unbundled.*/
+// NOTE: The cartridge and the bus are REQUIRED to be reset to a known state before operating on them.
 namespace mbc1
 {
     const uint8_t RAM_ENABLE_PATTERN = 0b00001010;
@@ -108,113 +99,65 @@ namespace mbc1
         MODE        = 0x6000
     };
 
-    void reset_cartridge()
+    void mapper::reset()
     {
+        _clear_register_states();
+
         _write_register(registers::RAMG, 0);
         _write_register(registers::BANK1, 0);
         _write_register(registers::BANK2_RAMB, 0);
         _write_register(registers::MODE, 0);
 
-        reset_pmod();
+        bus_reset();
     }
 
-    /* NOTE: This function reads the header into the cartridge buffer and returns a pointer to it.
-             The pointer is invalid as soon as new data is being written into the cartridge buffer. */
-    cartridge_header* read_header()
+    uint16_t mapper::select_rom_bank(uint16_t bank)
     {
-        reset_cartridge();
-
-        _write_register(registers::MODE, 0);
-
-        for (uint16_t address = HEADER_BASE_ADDRESS;
-            address < HEADER_BASE_ADDRESS + sizeof(cartridge_header);
-            ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
-
-            _shiftout_address(address);
-            cartridge_buffer[address] = _shiftin_data();
-
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
-
-        return (cartridge_header*)&cartridge_buffer[HEADER_BASE_ADDRESS];
-    }
-
-    void read_rom(uint8_t bank)
-    {
-        reset_cartridge();
-
-        uint16_t bank_base_address = ROM_BANK_AREA1_BASE_ADDRESS;
-
-        if ((bank & 0b11111) != 0)
-            bank_base_address = ROM_BANK_AREA2_BASE_ADDRESS;
-
         _write_register(registers::MODE, 1);
         _write_register(registers::BANK1, bank & 0b11111);
         _write_register(registers::BANK2_RAMB, (bank >> 5) & 0b11);
 
-        for (uint16_t address = 0; address < ROM_BANK_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
-
-            _shiftout_address(bank_base_address + address);
-            cartridge_buffer[address] = _shiftin_data();
+        // In mode 1 the BANK2 bits also apply to area 1 so banks 0x20/0x40/0x60 show up there.
+        if ((bank & 0b11111) == 0)
+            return ROM_BANK_AREA1_BASE_ADDRESS;
 
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
+        return ROM_BANK_AREA2_BASE_ADDRESS;
     }
 
-    void read_ram(uint8_t bank)
+    void mapper::select_ram_bank(uint8_t bank)
     {
-        reset_cartridge();
-
         _write_register(registers::MODE, 1);
         _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
         _write_register(registers::BANK2_RAMB, bank);
+    }
 
-        for (uint16_t address = 0; address < RAM_BANK_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
+    /* NOTE: This function reads the header into the cartridge buffer and returns a pointer to it.
+             The pointer is invalid as soon as new data is being written into the cartridge buffer. */
+    cartridge_header* read_header()
+    {
+        STATS_PHASE_BEGIN(PHASE_HEADER_READ);
 
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
+        // The cartridge type is not known until the header has been read.
+        select_default_timing_profile();
+        mapper::reset();
 
-            pmod_state.CSn = 0;
-            write_pmod();
+        _write_register(registers::MODE, 0);
 
-            cartridge_buffer[address] = _shiftin_data();
+        bus_read(HEADER_BASE_ADDRESS, &cartridge_buffer[HEADER_BASE_ADDRESS], sizeof(cartridge_header), false);
 
-            pmod_state.CSn = 1;
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
+        STATS_PHASE_END(PHASE_HEADER_READ);
+
+        return (cartridge_header*)&cartridge_buffer[HEADER_BASE_ADDRESS];
     }
 
-    void write_ram(uint8_t bank)
+    // Reads from the fixed bank 0 area (0x0000 - 0x3FFF) with the active timing profile.
+    void read_rom_range(uint16_t address, uint8_t* destination, uint16_t count)
     {
-        reset_cartridge();
-
-        _write_register(registers::MODE, 1);
-        _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
-        _write_register(registers::BANK2_RAMB, bank);
-
-        for (uint16_t address = 0; address < RAM_BANK_SIZE; ++address)
-        {
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
+        mapper::reset();
 
-            pmod_state.CSn = 0;
-            write_pmod();
-
-            _shiftout_data(cartridge_buffer[address]);
+        _write_register(registers::MODE, 0);
 
-            pmod_state.CSn = 1;
-            write_pmod();
-        }
+        bus_read(address, destination, count, false);
     }
 }
 
@@ -228,82 +171,30 @@ namespace mbc2
         ROMB    = 0x0100
     };
 
-    void reset_cartridge()
+    void mapper::reset()
     {
+        _clear_register_states();
+
         _write_register(registers::RAMG, 0);
         _write_register(registers::ROMB, 0);
 
-        reset_pmod();
+        bus_reset();
     }
 
-    void read_rom(uint8_t bank)
+    uint16_t mapper::select_rom_bank(uint16_t bank)
     {
-        reset_cartridge();
-
-        uint16_t bank_base_address = ROM_BANK_AREA1_BASE_ADDRESS;
-
-        if ((bank & 0b1111) != 0)
-            bank_base_address = ROM_BANK_AREA2_BASE_ADDRESS;
-
         _write_register(registers::ROMB, bank);
 
-        for (uint16_t address = 0; address < ROM_BANK_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
-
-            _shiftout_address(bank_base_address + address);
-            cartridge_buffer[address] = _shiftin_data();
-
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
-    }
-
-    void read_ram()
-    {
-        reset_cartridge();
-
-        _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
-
-        for (uint16_t address = 0; address < INTERNAL_RAM_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
-
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
+        if ((bank & 0b1111) == 0)
+            return ROM_BANK_AREA1_BASE_ADDRESS;
 
-            pmod_state.CSn = 0;
-            write_pmod();
-
-            // MBC2 internal RAM is only 4 bit wide, so disregard high nibble.
-            cartridge_buffer[address] = _shiftin_data() & 0b1111;
-
-            pmod_state.CSn = 1;
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
+        return ROM_BANK_AREA2_BASE_ADDRESS;
     }
 
-    void write_ram()
+    // MBC2 has no RAM banking, the internal RAM only needs to be enabled.
+    void mapper::select_ram_bank(uint8_t)
     {
-        reset_cartridge();
-
         _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
-
-        for (uint16_t address = 0; address < INTERNAL_RAM_SIZE; ++address)
-        {
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
-
-            pmod_state.CSn = 0;
-            write_pmod();
-
-            // See mbc2::read_ram()
-            _shiftout_data(cartridge_buffer[address] & 0b1111);
-
-            pmod_state.CSn = 1;
-            write_pmod();
-        }
     }
 }
 
@@ -319,85 +210,32 @@ namespace mbc3
         RCLK_RTC    = 0x6000
     };
 
-    void reset_cartridge()
+    void mapper::reset()
     {
+        _clear_register_states();
+
         _write_register(registers::RAMG_RTCRG, 0);
         _write_register(registers::ROMB, 0);
         _write_register(registers::RAMB_RTCRS, 0);
         _write_register(registers::RCLK_RTC, 0);
 
-        reset_pmod();
+        bus_reset();
     }
 
-    void read_rom(uint8_t bank)
+    uint16_t mapper::select_rom_bank(uint16_t bank)
     {
-        reset_cartridge();
-
-        uint16_t bank_base_address = ROM_BANK_AREA1_BASE_ADDRESS;
-
-        if (bank != 0)
-            bank_base_address = ROM_BANK_AREA2_BASE_ADDRESS;
-
         _write_register(registers::ROMB, bank);
 
-        for (uint16_t address = 0; address < ROM_BANK_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
-
-            _shiftout_address(bank_base_address + address);
-            cartridge_buffer[address] = _shiftin_data();
-
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
+        if (bank == 0)
+            return ROM_BANK_AREA1_BASE_ADDRESS;
 
+        return ROM_BANK_AREA2_BASE_ADDRESS;
     }
 
-    void read_ram(uint8_t bank)
+    void mapper::select_ram_bank(uint8_t bank)
     {
-        reset_cartridge();
-
         _write_register(registers::RAMG_RTCRG, RAM_RTC_ENABLE_PATTERN);
         _write_register(registers::RAMB_RTCRS, bank);
-
-        for (uint16_t address = 0; address < RAM_BANK_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
-
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
-
-            pmod_state.CSn = 0;
-            write_pmod();
-
-            cartridge_buffer[address] = _shiftin_data();
-
-            pmod_state.CSn = 1;
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
-    }
-
-    void write_ram(uint8_t bank)
-    {
-        reset_cartridge();
-
-        _write_register(registers::RAMG_RTCRG, RAM_RTC_ENABLE_PATTERN);
-        _write_register(registers::RAMB_RTCRS, bank);
-
-        for (uint16_t address = 0; address < RAM_BANK_SIZE; ++address)
-        {
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
-
-            pmod_state.CSn = 0;
-            write_pmod();
-
-            _shiftout_data(cartridge_buffer[address]);
-
-            pmod_state.CSn = 1;
-            write_pmod();
-        }
     }
 }
 
@@ -413,87 +251,280 @@ namespace mbc5
         RAMB    = 0x4000
     };
 
-    void reset_cartridge()
+    void mapper::reset()
     {
+        _clear_register_states();
+
         _write_register(registers::RAMG, 0);
         _write_register(registers::ROMB1, 0);
         _write_register(registers::ROMB2, 0);
         _write_register(registers::RAMB, 0);
 
-        reset_pmod();
+        bus_reset();
     }
 
-    void read_rom(uint16_t bank)
+    // MBC5 can map bank 0 into area 2 as well, so it is always read from there.
+    uint16_t mapper::select_rom_bank(uint16_t bank)
     {
-        reset_cartridge();
-
-        uint16_t bank_base_address = ROM_BANK_AREA2_BASE_ADDRESS;
-
         _write_register(registers::ROMB1, bank & 0xff);
         _write_register(registers::ROMB2, (bank >> 8) & 0b1);
 
-        for (uint16_t address = 0; address < ROM_BANK_SIZE; ++address)
-        {
-            pmod_state.RDn = 0;
-            write_pmod();
+        return ROM_BANK_AREA2_BASE_ADDRESS;
+    }
 
-            _shiftout_address(bank_base_address + address);
-            cartridge_buffer[address] = _shiftin_data();
+    void mapper::select_ram_bank(uint8_t bank)
+    {
+        _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
+        _write_register(registers::RAMB, bank);
+    }
+}
 
-            pmod_state.RDn = 1;
-            write_pmod();
-        }
+template <typename Mapper>
+void read_rom(uint16_t bank, uint16_t offset, uint16_t count)
+{
+    uint16_t bank_base_address = Mapper::select_rom_bank(bank);
 
+    bus_read(bank_base_address + offset, cartridge_buffer, count, false);
+}
+
+template <typename Mapper>
+void read_ram(uint8_t bank, uint16_t offset, uint16_t count)
+{
+    Mapper::select_ram_bank(bank);
+
+    bus_read(RAM_BANK_RTC_BASE_ADDRESS + offset, cartridge_buffer, count, true);
+
+    // MBC2 internal RAM is only 4 bit wide, so disregard high nibble.
+    if constexpr (Mapper::RAM_DATA_MASK != 0xff)
+    {
+        for (uint16_t address = 0; address < count; ++address)
+            cartridge_buffer[address] &= Mapper::RAM_DATA_MASK;
     }
+}
+
+template <typename Mapper>
+void write_ram(uint8_t bank)
+{
+    Mapper::select_ram_bank(bank);
 
-    void read_ram(uint8_t bank)
+    // See read_ram()
+    if constexpr (Mapper::RAM_DATA_MASK != 0xff)
     {
-        reset_cartridge();
+        for (uint16_t address = 0; address < Mapper::RAM_BANK_SIZE; ++address)
+            cartridge_buffer[address] &= Mapper::RAM_DATA_MASK;
+    }
 
-        _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
-        _write_register(registers::RAMB, bank);
+    bus_write(RAM_BANK_RTC_BASE_ADDRESS, cartridge_buffer, Mapper::RAM_BANK_SIZE);
+}
+
+/*
+    NOTE: Reading a byte costs one address shift while writing one costs an address and a data
+          shift, so the bank is compared in chunks first and only the runs of bytes that differ
+          are written. Restoring a save that mostly matches the cartridge gets close to read speed.
+*/
+const uint16_t DELTA_CHUNK_SIZE = 256;
+
+// Compares the bank with cartridge_buffer and returns the number of bytes that differ, writes them if asked to.
+template <typename Mapper>
+static uint16_t _compare_ram(uint8_t bank, bool write)
+{
+    static uint8_t current_chunk[DELTA_CHUNK_SIZE];
 
-        for (uint16_t address = 0; address < RAM_BANK_SIZE; ++address)
+    Mapper::select_ram_bank(bank);
+
+    uint16_t bytes_differing = 0;
+
+    for (uint16_t offset = 0; offset < Mapper::RAM_BANK_SIZE; offset += DELTA_CHUNK_SIZE)
+    {
+        uint16_t chunk_size = Mapper::RAM_BANK_SIZE - offset < DELTA_CHUNK_SIZE ? Mapper::RAM_BANK_SIZE - offset : DELTA_CHUNK_SIZE;
+        uint8_t* data = &cartridge_buffer[offset];
+
+        bus_read(RAM_BANK_RTC_BASE_ADDRESS + offset, current_chunk, chunk_size, true);
+
+        // See read_ram()
+        if constexpr (Mapper::RAM_DATA_MASK != 0xff)
         {
-            pmod_state.RDn = 0;
-            write_pmod();
+            for (uint16_t i = 0; i < chunk_size; ++i)
+            {
+                data[i] &= Mapper::RAM_DATA_MASK;
+                current_chunk[i] &= Mapper::RAM_DATA_MASK;
+            }
+        }
 
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
+        if (!memcmp(current_chunk, data, chunk_size))
+            continue;
 
-            pmod_state.CSn = 0;
-            write_pmod();
+        for (uint16_t i = 0; i < chunk_size; )
+        {
+            if (current_chunk[i] == data[i])
+            {
+                i++;
+                continue;
+            }
 
-            cartridge_buffer[address] = _shiftin_data();
+            uint16_t run_start = i;
+            while (i < chunk_size && current_chunk[i] != data[i])
+                i++;
 
-            pmod_state.CSn = 1;
-            pmod_state.RDn = 1;
-            write_pmod();
+            if (write)
+                bus_write(RAM_BANK_RTC_BASE_ADDRESS + offset + run_start, &data[run_start], i - run_start);
+
+            bytes_differing += i - run_start;
         }
+    }
+
+    return bytes_differing;
+}
 
+template <typename Mapper>
+uint16_t write_ram_delta(uint8_t bank)
+{
+    return _compare_ram<Mapper>(bank, true);
+}
+
+template <typename Mapper>
+void verify_written_ram(uint8_t bank, verify_result& result)
+{
+    result = {};
+
+    for (unsigned round = 0; round <= VERIFY_RETRIES; ++round)
+    {
+        // The last round only checks whether the rewrites stuck.
+        uint16_t bytes_differing = _compare_ram<Mapper>(bank, round < VERIFY_RETRIES);
+
+        if (round == 0)
+            result.mismatches = bytes_differing;
+
+        if (bytes_differing == 0)
+            break;
+
+        if (round == VERIFY_RETRIES)
+            result.unresolved = bytes_differing;
+        else
+            result.rewrites += bytes_differing;
     }
+}
+
+const uint16_t CONSENSUS_CHUNK_SIZE = 256;
+
+// Reads the byte until one value has the absolute majority of all possible votes.
+static uint8_t _vote(uint16_t address, bool chip_select, uint8_t data_mask, uint8_t first, uint8_t second, consensus_result& result)
+{
+    const unsigned MAX_VOTES = 2 + CONSENSUS_RETRIES;
+
+    uint8_t values[MAX_VOTES] = { first, second };
+    uint8_t votes[MAX_VOTES] = { 1, 1 };
+    unsigned num_values = 2;
+    unsigned best = 0;
 
-    void write_ram(uint8_t bank)
+    for (unsigned retry = 0; retry < CONSENSUS_RETRIES && votes[best] <= MAX_VOTES / 2; ++retry)
     {
-        reset_cartridge();
+        uint8_t value;
+        bus_read(address, &value, 1, chip_select);
+        value &= data_mask;
 
-        _write_register(registers::RAMG, RAM_ENABLE_PATTERN);
-        _write_register(registers::RAMB, bank);
+        result.retries++;
 
-        for (uint16_t address = 0; address < RAM_BANK_SIZE; ++address)
+        unsigned index = 0;
+        while (index < num_values && values[index] != value)
+            index++;
+
+        if (index == num_values)
         {
-            _shiftout_address(RAM_BANK_RTC_BASE_ADDRESS + address);
+            values[num_values] = value;
+            votes[num_values++] = 0;
+        }
+
+        if (++votes[index] > votes[best])
+            best = index;
+    }
+
+    if (votes[best] <= MAX_VOTES / 2)
+        result.unresolved++;
 
-            pmod_state.CSn = 0;
-            write_pmod();
+    return values[best];
+}
+
+static void _verify_range(uint16_t base_address, uint16_t count, bool chip_select, uint8_t data_mask, consensus_result& result)
+{
+    static uint8_t verify_chunk[CONSENSUS_CHUNK_SIZE];
+
+    result = {};
+
+    for (uint16_t offset = 0; offset < count; offset += CONSENSUS_CHUNK_SIZE)
+    {
+        uint16_t chunk_size = count - offset < CONSENSUS_CHUNK_SIZE ? count - offset : CONSENSUS_CHUNK_SIZE;
+        uint8_t* data = &cartridge_buffer[offset];
 
-            _shiftout_data(cartridge_buffer[address]);
+        bus_read(base_address + offset, verify_chunk, chunk_size, chip_select);
 
-            pmod_state.CSn = 1;
-            write_pmod();
+        if (data_mask == 0xff && !memcmp(verify_chunk, data, chunk_size))
+            continue;
+
+        for (uint16_t i = 0; i < chunk_size; ++i)
+        {
+            uint8_t value = verify_chunk[i] & data_mask;
+            if (value == data[i])
+                continue;
+
+            result.mismatches++;
+            data[i] = _vote(base_address + offset + i, chip_select, data_mask, data[i], value, result);
         }
     }
 }
 
+// The bank is still selected from read_rom(), selecting it again is elided by the register cache.
+template <typename Mapper>
+void verify_rom(uint16_t bank, consensus_result& result)
+{
+    uint16_t bank_base_address = Mapper::select_rom_bank(bank);
+
+    _verify_range(bank_base_address, ROM_BANK_SIZE, false, 0xff, result);
+}
+
+template <typename Mapper>
+void verify_ram(uint8_t bank, consensus_result& result)
+{
+    Mapper::select_ram_bank(bank);
+
+    _verify_range(RAM_BANK_RTC_BASE_ADDRESS, Mapper::RAM_BANK_SIZE, true, Mapper::RAM_DATA_MASK, result);
+}
+
+template void read_rom<mbc1::mapper>(uint16_t, uint16_t, uint16_t);
+template void read_rom<mbc2::mapper>(uint16_t, uint16_t, uint16_t);
+template void read_rom<mbc3::mapper>(uint16_t, uint16_t, uint16_t);
+template void read_rom<mbc5::mapper>(uint16_t, uint16_t, uint16_t);
+
+template void read_ram<mbc1::mapper>(uint8_t, uint16_t, uint16_t);
+template void read_ram<mbc2::mapper>(uint8_t, uint16_t, uint16_t);
+template void read_ram<mbc3::mapper>(uint8_t, uint16_t, uint16_t);
+template void read_ram<mbc5::mapper>(uint8_t, uint16_t, uint16_t);
+
+template void write_ram<mbc1::mapper>(uint8_t);
+template void write_ram<mbc2::mapper>(uint8_t);
+template void write_ram<mbc3::mapper>(uint8_t);
+template void write_ram<mbc5::mapper>(uint8_t);
+
+template uint16_t write_ram_delta<mbc1::mapper>(uint8_t);
+template uint16_t write_ram_delta<mbc2::mapper>(uint8_t);
+template uint16_t write_ram_delta<mbc3::mapper>(uint8_t);
+template uint16_t write_ram_delta<mbc5::mapper>(uint8_t);
+
+template void verify_rom<mbc1::mapper>(uint16_t, consensus_result&);
+template void verify_rom<mbc2::mapper>(uint16_t, consensus_result&);
+template void verify_rom<mbc3::mapper>(uint16_t, consensus_result&);
+template void verify_rom<mbc5::mapper>(uint16_t, consensus_result&);
+
+template void verify_ram<mbc1::mapper>(uint8_t, consensus_result&);
+template void verify_ram<mbc2::mapper>(uint8_t, consensus_result&);
+template void verify_ram<mbc3::mapper>(uint8_t, consensus_result&);
+template void verify_ram<mbc5::mapper>(uint8_t, consensus_result&);
+
+template void verify_written_ram<mbc1::mapper>(uint8_t, verify_result&);
+template void verify_written_ram<mbc2::mapper>(uint8_t, verify_result&);
+template void verify_written_ram<mbc3::mapper>(uint8_t, verify_result&);
+template void verify_written_ram<mbc5::mapper>(uint8_t, verify_result&);
+
 const char* get_cartridge_type_string(uint8_t cartridge_type)
 {
     switch (cartridge_type)
@@ -18,7 +18,20 @@ const uint8_t NINTENDO_LOGO[0x30] = {
     0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
 };
 
-extern uint8_t cartridge_buffer[ROM_BANK_SIZE];
+/*
+    All cartridge routines operate on cartridge_buffer, which points to one of two banks
+    of memory. Swapping them allows reading the next bank while the previous one is still
+    being sent over UART (see Uart_QueueBytes).
+*/
+extern uint8_t* cartridge_buffer;
+void swap_cartridge_buffers();
+
+// The buffer swap_cartridge_buffers() switches to, e.g. to receive the next bank into.
+uint8_t* get_other_cartridge_buffer();
+
+// Scratch buffer that is never swapped in, e.g. for the compressed or framed form of cartridge_buffer.
+const uint32_t SPARE_CARTRIDGE_BUFFER_SIZE = ROM_BANK_SIZE + 0x400;
+uint8_t* get_spare_cartridge_buffer();
 
 enum cartridge_type: uint8_t
 {
@@ -69,33 +82,197 @@ struct cartridge_header
     uint8_t global_checksum[2];     // 0x14E - 0x14F
 } __attribute__((packed));
 
+/*
+    Every mapper is described by a policy with the same static interface:
+      reset()                 Puts all mapper registers into their power-up state and resets the bus.
+      select_rom_bank(bank)   Switches the bank in and returns the window it appears in.
+      select_ram_bank(bank)   Enables the RAM and switches the bank in.
+      RAM_BANK_SIZE           Size of one RAM bank.
+      RAM_DATA_MASK           Bits of a RAM byte that are actually stored.
+
+    The transfer routines below are templated on the policy so they compile into one
+    straight loop per mapper. The mapper is resolved once per command with
+    dispatch_rom_mapper/dispatch_ram_mapper instead of once per bank.
+
+    Register writes are cached, so reset() is called once per command before the first
+    transfer and the transfers themselves only write the registers that actually change.
+*/
 namespace mbc1
 {
     cartridge_header* read_header();
-    void read_rom(uint8_t bank);
-    void read_ram(uint8_t bank);
-    void write_ram(uint8_t bank);
+    void read_rom_range(uint16_t address, uint8_t* destination, uint16_t count);
+
+    struct mapper
+    {
+        static const uint16_t RAM_BANK_SIZE = ::RAM_BANK_SIZE;
+        static const uint8_t RAM_DATA_MASK = 0xff;
+
+        static void reset();
+        static uint16_t select_rom_bank(uint16_t bank);
+        static void select_ram_bank(uint8_t bank);
+    };
 }
 
 namespace mbc2
 {
-    void read_rom(uint8_t bank);
-    void read_ram();
-    void write_ram();
+    struct mapper
+    {
+        // MBC2 has 512 x 4 bits of RAM built in, which is treated as a single bank.
+        static const uint16_t RAM_BANK_SIZE = INTERNAL_RAM_SIZE;
+        static const uint8_t RAM_DATA_MASK = 0x0f;
+
+        static void reset();
+        static uint16_t select_rom_bank(uint16_t bank);
+        static void select_ram_bank(uint8_t bank);
+    };
 }
 
 namespace mbc3
 {
-    void read_rom(uint8_t bank);
-    void read_ram(uint8_t bank);
-    void write_ram(uint8_t bank);
+    struct mapper
+    {
+        static const uint16_t RAM_BANK_SIZE = ::RAM_BANK_SIZE;
+        static const uint8_t RAM_DATA_MASK = 0xff;
+
+        static void reset();
+        static uint16_t select_rom_bank(uint16_t bank);
+        static void select_ram_bank(uint8_t bank);
+    };
 }
 
 namespace mbc5
 {
-    void read_rom(uint16_t bank);
-    void read_ram(uint8_t bank);
-    void write_ram(uint8_t bank);
+    struct mapper
+    {
+        static const uint16_t RAM_BANK_SIZE = ::RAM_BANK_SIZE;
+        static const uint8_t RAM_DATA_MASK = 0xff;
+
+        static void reset();
+        static uint16_t select_rom_bank(uint16_t bank);
+        static void select_ram_bank(uint8_t bank);
+    };
+}
+
+// Reading only part of a bank puts the count bytes from offset at the start of cartridge_buffer.
+template <typename Mapper> void read_rom(uint16_t bank, uint16_t offset = 0, uint16_t count = ROM_BANK_SIZE);
+template <typename Mapper> void read_ram(uint8_t bank, uint16_t offset = 0, uint16_t count = Mapper::RAM_BANK_SIZE);
+template <typename Mapper> void write_ram(uint8_t bank);
+
+// Same as write_ram but only writes the bytes that differ from the cartridge, returns their number.
+template <typename Mapper> uint16_t write_ram_delta(uint8_t bank);
+
+/*
+    Reads the bank that was just written back and compares it with cartridge_buffer.
+    Bytes that did not stick are written again, up to VERIFY_RETRIES times.
+*/
+const unsigned VERIFY_RETRIES = 3;
+
+struct verify_result
+{
+    uint16_t mismatches;    // Bytes that differed on the first read back
+    uint16_t rewrites;      // Bytes written again in total
+    uint16_t unresolved;    // Bytes that still differ after the last retry
+};
+
+template <typename Mapper> void verify_written_ram(uint8_t bank, verify_result& result);
+
+/*
+    Consensus reads check the bank that was just read into cartridge_buffer by reading it
+    a second time in small chunks. Only bytes that differ are read again one by one, up to
+    CONSENSUS_RETRIES times, and the value read most often is kept in cartridge_buffer.
+*/
+const unsigned CONSENSUS_RETRIES = 5;
+
+struct consensus_result
+{
+    uint16_t mismatches;    // Bytes that differed between the first two reads
+    uint16_t retries;       // Single byte reads spent on them
+    uint16_t unresolved;    // Bytes where no value got the absolute majority
+};
+
+template <typename Mapper> void verify_rom(uint16_t bank, consensus_result& result);
+template <typename Mapper> void verify_ram(uint8_t bank, consensus_result& result);
+
+// Calls visitor with the mapper policy of the cartridge, returns false if it is not supported.
+template <typename Visitor>
+bool dispatch_rom_mapper(uint8_t cartridge_type, Visitor&& visitor)
+{
+    switch (cartridge_type)
+    {
+        // Even though the ROM-only has no MBC and therefore no registers,
+        // we can simply use the MBC1 methods as the register writes will
+        // not cause any harm since the WRn pin is unconnected on these cartridges.
+        case cartridge_type::ROM:
+
+        case cartridge_type::MBC1:
+        case cartridge_type::MBC1_RAM:
+        case cartridge_type::MBC1_RAM_BATTERY:
+            visitor(mbc1::mapper());
+            return true;
+
+        case cartridge_type::MBC2:
+        case cartridge_type::MBC2_BATTERY:
+            visitor(mbc2::mapper());
+            return true;
+
+        case cartridge_type::MBC3:
+        case cartridge_type::MBC3_RAM:
+        case cartridge_type::MBC3_RAM_BATTERY:
+        case cartridge_type::MBC3_RTC_BATTERY:
+        case cartridge_type::MBC3_RTC_RAM_BATTERY:
+            visitor(mbc3::mapper());
+            return true;
+
+        case cartridge_type::MBC5:
+        case cartridge_type::MBC5_RAM:
+        case cartridge_type::MBC5_RAM_BATTERY:
+        case cartridge_type::MBC5_RUMBLE:
+        case cartridge_type::MBC5_RUMBLE_RAM:
+        case cartridge_type::MBC5_RUMBLE_RAM_BATTERY:
+            visitor(mbc5::mapper());
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Same as dispatch_rom_mapper but only for cartridges that have RAM.
+template <typename Visitor>
+bool dispatch_ram_mapper(uint8_t cartridge_type, Visitor&& visitor)
+{
+    switch (cartridge_type)
+    {
+        case cartridge_type::MBC1_RAM:
+        case cartridge_type::MBC1_RAM_BATTERY:
+            visitor(mbc1::mapper());
+            return true;
+
+        case cartridge_type::MBC2:
+        case cartridge_type::MBC2_BATTERY:
+            visitor(mbc2::mapper());
+            return true;
+
+        case cartridge_type::MBC3_RAM:
+        case cartridge_type::MBC3_RAM_BATTERY:
+        case cartridge_type::MBC3_RTC_RAM_BATTERY:
+            visitor(mbc3::mapper());
+            return true;
+
+        case cartridge_type::MBC5_RAM:
+        case cartridge_type::MBC5_RAM_BATTERY:
+
+        // Bit 3 of RAMB controls the rumble motor on these cartridges but since
+        // the cartridge will not have so many banks to accidentally trigger the rumble
+        // this works just as well.
+        case cartridge_type::MBC5_RUMBLE_RAM:
+        case cartridge_type::MBC5_RUMBLE_RAM_BATTERY:
+            visitor(mbc5::mapper());
+            return true;
+
+        default:
+            return false;
+    }
 }
 
 const char* get_cartridge_type_string(uint8_t cartridge_type);
@@ -2,32 +2,966 @@
 
 #include <cstdint>
 #include <string.h>
+#include <stdlib.h>
 
 #include "uart.h"
 #include "cartridge.h"
+#include "bus.h"
 #include "misc.h"
 #include "print.h"
+#include "timing.h"
+#include "stats.h"
+#include "capture.h"
+#include "compression.h"
+#include "hash.h"
 
 // TODO: Implement timeout of 3s?
 // TODO: Call virtual printf so platform agnostic? (Zynq/Arduino)
 
+inline static void __send_uint32(uint32_t value)
+{
+    uint8_t bytes[4];
+
+    for (unsigned i = 0; i < 4; ++i)
+        bytes[i] = (uint8_t)(value >> (i * 8));
+
+    Uart_Send(STDOUT_BASEADDRESS, bytes, sizeof(bytes));
+}
+
+inline static uint32_t __receive_uint32()
+{
+    uint8_t bytes[4];
+    Uart_Recv(STDOUT_BASEADDRESS, bytes, sizeof(bytes));
+
+    uint32_t value = 0;
+    for (unsigned i = 0; i < 4; ++i)
+        value |= ((uint32_t)bytes[i]) << (i * 8);
+
+    return value;
+}
+
 inline static void __print_response_header(response_t code, uint32_t payload_size = 0)
 {
-    Uart_SendByte(STDOUT_BASEADDRESS, code);
+    Uart_SendByte(STDOUT_BASEADDRESS, code);
+
+    if (payload_size > 0)
+        __send_uint32(payload_size);
+}
+
+// Checksum over the title up to the version (0x0134 - 0x014C) as the boot ROM calculates it.
+static uint8_t __calculate_header_checksum(const cartridge_header* header)
+{
+    uint8_t calculated_checksum = 0;
+    for (uint16_t address = 4 + 48; address < sizeof(cartridge_header) - 2 - 1; ++address)
+        calculated_checksum -= ((const uint8_t*)header)[address] + 1;
+
+    return calculated_checksum;
+}
+
+static bool __is_header_valid(const cartridge_header* header)
+{
+    return !memcmp(header->nintendo_logo, NINTENDO_LOGO, arraysizeof(NINTENDO_LOGO))
+        && header->header_checksum == __calculate_header_checksum(header);
+}
+
+/*
+    NOTE: Reading a bank and sending it take about the same time, so the banks are read
+          into alternating cartridge buffers and sent from the queue while the bus is busy
+          reading the next one. Queueing a bank waits for the previous one to be sent.
+
+    NOTE: In compressed mode every bank is preceded by its bank_encoding and its size as
+          16 bit little endian, banks that do not get smaller are sent raw. The payload size
+          in the response header stays the uncompressed size of the whole transfer.
+          The compressed bank is sent from the spare buffer, so compressing the next one
+          has to wait for it. Compression is a fraction of the time sending a bank takes.
+
+    NOTE: In hashed mode the SHA-1 of every bank is sent first and the PC answers whether it
+          needs the bank (BANK_REQUEST_SEND) or already has it (BANK_REQUEST_SKIP), e.g. from
+          its bank cache or an image it verifies against. Known banks only cost the bus time.
+*/
+enum transfer_flags: uint8_t
+{
+    TRANSFER_COMPRESSED     = 1 << 0,
+    TRANSFER_HASHED         = 1 << 1,
+    TRANSFER_FRAMED         = 1 << 2,
+    TRANSFER_CONSENSUS      = 1 << 3,
+    TRANSFER_INTEGRITY      = 1 << 4,
+    TRANSFER_DELTA          = 1 << 5,
+    TRANSFER_VERIFY         = 1 << 6
+};
+
+static const struct
+{
+    const char* name;
+    uint8_t flag;
+} transfer_flag_names[] = {
+    { "compressed", TRANSFER_COMPRESSED },
+    { "hashed",     TRANSFER_HASHED },
+    { "framed",     TRANSFER_FRAMED },
+    { "consensus",  TRANSFER_CONSENSUS },
+    { "integrity",  TRANSFER_INTEGRITY },
+    { "delta",      TRANSFER_DELTA },
+    { "verify",     TRANSFER_VERIFY },
+};
+
+enum bank_request: uint8_t
+{
+    BANK_REQUEST_SEND       = 0,
+    BANK_REQUEST_SKIP       = 1
+};
+
+// Parses the space separated flags of the transfer commands, fails on any flag not in allowed.
+static bool __parse_transfer_flags(const char* arguments, uint8_t allowed, uint8_t& flags)
+{
+    flags = 0;
+
+    while (*arguments != '\0')
+    {
+        const char* end = strchr(arguments, ' ');
+        if (end == nullptr)
+            end = arguments + strlen(arguments);
+
+        size_t length = end - arguments;
+        uint8_t flag = 0;
+
+        for (uint8_t i = 0; i < arraysizeof(transfer_flag_names); ++i)
+        {
+            if (strlen(transfer_flag_names[i].name) == length
+                && !strncmp(arguments, transfer_flag_names[i].name, length))
+                flag = transfer_flag_names[i].flag;
+        }
+
+        if ((flag & allowed) == 0)
+            return false;
+
+        flags |= flag;
+        arguments = *end == ' ' ? end + 1 : end;
+    }
+
+    // Frames are built from the raw bank and checked by their CRC instead.
+    return !(flags & TRANSFER_FRAMED) || !(flags & (TRANSFER_COMPRESSED | TRANSFER_HASHED));
+}
+
+// Queues the bank in cartridge_buffer for sending and swaps the buffers.
+static void __queue_bank(uint16_t size, bool compressed)
+{
+    const uint8_t* data = cartridge_buffer;
+
+    if (compressed)
+    {
+        uint8_t* spare_buffer = get_spare_cartridge_buffer();
+
+        STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+        Uart_Flush();
+        STATS_PHASE_END(PHASE_UART_DRAIN);
+
+        STATS_PHASE_BEGIN(PHASE_COMPRESSION);
+        uint16_t compressed_size = compress_bank(cartridge_buffer, size, spare_buffer);
+        STATS_PHASE_END(PHASE_COMPRESSION);
+
+        if (compressed_size != 0)
+        {
+            data = spare_buffer;
+            size = compressed_size;
+        }
+
+        uint8_t bank_header[3] = {
+            compressed_size != 0 ? BANK_COMPRESSED : BANK_RAW,
+            (uint8_t)size,
+            (uint8_t)(size >> 8)
+        };
+
+        Uart_Send(STDOUT_BASEADDRESS, bank_header, sizeof(bank_header));
+    }
+
+    STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+    Uart_QueueBytes(STDOUT_BASEADDRESS, data, size);
+    STATS_PHASE_END(PHASE_UART_DRAIN);
+
+    swap_cartridge_buffers();
+}
+
+/*
+    NOTE: In framed mode every bank is split into frames of FRAME_PAYLOAD_SIZE bytes. A frame is
+          FRAME_MAGIC, the sequence number, bank, offset and payload length (16 bit little endian),
+          the payload and the CRC-32 of all of it. The sequence number is the index of the frame
+          in the whole transfer, so a resent frame keeps its number.
+
+          The framed bank is queued from the spare buffer and the next bank is read meanwhile.
+          Before that one is sent, the PC answers with the bitmap of the frames it did not get
+          intact, the bank it is receiving and the CRC-32 of both. Those frames are sent again
+          from the spare buffer until the bitmap is empty. An answer for a later bank means the
+          PC already got this one and the confirmation was lost. A garbled or missing answer
+          asks for the whole bank again, a PC that does not answer at all ends the transfer
+          after FRAME_MAX_ROUNDS.
+
+          A transfer that is given up ends with an abort frame instead of any further frames
+          or trailers: FRAME_MAGIC, sequence FRAME_ABORT_SEQUENCE, the bank, offset and length 0
+          and the CRC-32 of those 9 bytes. Nothing of the transfer follows it.
+*/
+const uint8_t FRAME_MAGIC = 0xf5;
+const uint16_t FRAME_PAYLOAD_SIZE = 512;
+const uint16_t FRAME_HEADER_SIZE = 9;
+const uint16_t FRAME_CRC_SIZE = 4;
+const uint16_t FRAME_SIZE = FRAME_HEADER_SIZE + FRAME_PAYLOAD_SIZE + FRAME_CRC_SIZE;
+
+const uint16_t FRAME_ABORT_SEQUENCE = 0xffff;
+
+const unsigned FRAME_MAX_ROUNDS = 16;
+const uint32_t FRAME_ANSWER_TIMEOUT_US = 1000000;
+const uint32_t FRAME_DRAIN_TIMEOUT_US = 10000;
+
+static_assert(ROM_BANK_SIZE / FRAME_PAYLOAD_SIZE <= 32, "The frames of a bank have to fit the bitmap.");
+static_assert(ROM_BANK_SIZE / FRAME_PAYLOAD_SIZE * FRAME_SIZE <= SPARE_CARTRIDGE_BUFFER_SIZE, "A framed bank has to fit the spare buffer.");
+
+// Frames of the bank in the spare buffer that the PC has not confirmed yet.
+static unsigned framed_bank;
+static unsigned framed_frames = 0;
+
+static void __queue_framed_bank(unsigned bank, uint16_t size)
+{
+    uint8_t* frame = get_spare_cartridge_buffer();
+
+    for (uint16_t offset = 0; offset < size; offset += FRAME_PAYLOAD_SIZE, frame += FRAME_SIZE)
+    {
+        uint16_t fields[4] = {
+            (uint16_t)((bank * size + offset) / FRAME_PAYLOAD_SIZE),
+            (uint16_t)bank,
+            offset,
+            FRAME_PAYLOAD_SIZE
+        };
+
+        frame[0] = FRAME_MAGIC;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            frame[1 + i * 2] = (uint8_t)fields[i];
+            frame[2 + i * 2] = (uint8_t)(fields[i] >> 8);
+        }
+
+        memcpy(&frame[FRAME_HEADER_SIZE], &cartridge_buffer[offset], FRAME_PAYLOAD_SIZE);
+
+        uint32_t crc = crc32(0, frame, FRAME_HEADER_SIZE + FRAME_PAYLOAD_SIZE);
+        for (unsigned i = 0; i < FRAME_CRC_SIZE; ++i)
+            frame[FRAME_HEADER_SIZE + FRAME_PAYLOAD_SIZE + i] = (uint8_t)(crc >> (i * 8));
+    }
+
+    framed_bank = bank;
+    framed_frames = size / FRAME_PAYLOAD_SIZE;
+
+    STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+    Uart_QueueBytes(STDOUT_BASEADDRESS, get_spare_cartridge_buffer(), framed_frames * FRAME_SIZE);
+    STATS_PHASE_END(PHASE_UART_DRAIN);
+}
+
+// Tells the PC that the transfer was given up, see the NOTE above.
+static void __abort_framed_transfer()
+{
+    uint8_t frame[FRAME_HEADER_SIZE + FRAME_CRC_SIZE] = {
+        FRAME_MAGIC,
+        (uint8_t)FRAME_ABORT_SEQUENCE, (uint8_t)(FRAME_ABORT_SEQUENCE >> 8),
+        (uint8_t)framed_bank, (uint8_t)(framed_bank >> 8),
+        0, 0,
+        0, 0
+    };
+
+    uint32_t crc = crc32(0, frame, FRAME_HEADER_SIZE);
+    for (unsigned i = 0; i < FRAME_CRC_SIZE; ++i)
+        frame[FRAME_HEADER_SIZE + i] = (uint8_t)(crc >> (i * 8));
+
+    Uart_Send(STDOUT_BASEADDRESS, frame, sizeof(frame));
+
+    STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+    Uart_Flush();
+    STATS_PHASE_END(PHASE_UART_DRAIN);
+}
+
+// Resends the frames the PC asks for. Returns false if it never confirmed the whole bank,
+// in which case the abort frame was sent.
+static bool __confirm_framed_bank()
+{
+    const uint8_t* frames = get_spare_cartridge_buffer();
+    uint32_t all_frames = framed_frames == 32 ? 0xffffffff : (1u << framed_frames) - 1;
+
+    for (unsigned round = 0; framed_frames != 0 && round < FRAME_MAX_ROUNDS; ++round)
+    {
+        // The timeout must not include sending the frames.
+        STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+        Uart_Flush();
+        STATS_PHASE_END(PHASE_UART_DRAIN);
+
+        // Bytes that never arrived must not end up in missing or crc.
+        uint8_t answer[10] = {};
+        bool answered = true;
+
+        for (unsigned i = 0; answered && i < sizeof(answer); ++i)
+            answered = Uart_RecvByteTimeout(STDOUT_BASEADDRESS, &answer[i], FRAME_ANSWER_TIMEOUT_US);
+
+        uint32_t missing = 0, crc = 0;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            missing |= (uint32_t)answer[i] << (i * 8);
+            crc |= (uint32_t)answer[6 + i] << (i * 8);
+        }
+
+        uint16_t bank = answer[4] | answer[5] << 8;
+        bool valid = answered && crc == crc32(0, answer, 6);
+
+        if (valid && bank > framed_bank)
+            missing = 0;
+        else if (!valid || bank != framed_bank)
+        {
+            // Whatever is left of a garbled answer must not be taken for the next one.
+            uint8_t discarded;
+            while (Uart_RecvByteTimeout(STDOUT_BASEADDRESS, &discarded, FRAME_DRAIN_TIMEOUT_US));
+
+            missing = all_frames;
+        }
+
+        missing &= all_frames;
+
+        if (missing == 0)
+            framed_frames = 0;
+
+        // Nothing is resent once the transfer is going to be given up.
+        if (round + 1 == FRAME_MAX_ROUNDS)
+            break;
+
+        for (unsigned frame = 0; frame < framed_frames; ++frame)
+        {
+            if (missing & (1u << frame))
+                Uart_QueueBytes(STDOUT_BASEADDRESS, &frames[frame * FRAME_SIZE], FRAME_SIZE);
+        }
+    }
+
+    bool confirmed = framed_frames == 0;
+    framed_frames = 0;
+
+    if (!confirmed)
+        __abort_framed_transfer();
+
+    return confirmed;
+}
+
+// Sends the bank in cartridge_buffer unless the PC skips it in hashed mode.
+// Returns false if the transfer has to be given up.
+static bool __send_bank(unsigned bank, uint16_t size, uint8_t flags)
+{
+    if (flags & TRANSFER_FRAMED)
+    {
+        // The previous bank was sent while this one was read.
+        if (!__confirm_framed_bank())
+            return false;
+
+        __queue_framed_bank(bank, size);
+        return true;
+    }
+
+    if (flags & TRANSFER_HASHED)
+    {
+        uint8_t digest[SHA1_DIGEST_SIZE];
+        sha1_context context;
+
+        STATS_PHASE_BEGIN(PHASE_HASH);
+        sha1_init(context);
+        sha1_update(context, cartridge_buffer, size);
+        sha1_final(context, digest);
+        STATS_PHASE_END(PHASE_HASH);
+
+        Uart_Send(STDOUT_BASEADDRESS, digest, sizeof(digest));
+
+        if (Uart_RecvByte(STDOUT_BASEADDRESS) == BANK_REQUEST_SKIP)
+            return true;
+    }
+
+    __queue_bank(size, flags & TRANSFER_COMPRESSED);
+    return true;
+}
+
+/*
+    NOTE: In consensus mode every bank is verified right after it was read (see verify_rom).
+          The consensus_result of every bank follows the data as a trailer (mismatches, retries
+          and unresolved bytes, 16 bit little endian each), so it works with all other modes.
+*/
+const unsigned MAX_ROM_BANKS = 512;
+static consensus_result consensus_results[MAX_ROM_BANKS];
+
+// Sends the three counters of a bank as 16 bit little endian each.
+static void __send_bank_result(uint16_t first, uint16_t second, uint16_t third)
+{
+    uint8_t fields[6] = {
+        (uint8_t)first,     (uint8_t)(first >> 8),
+        (uint8_t)second,    (uint8_t)(second >> 8),
+        (uint8_t)third,     (uint8_t)(third >> 8)
+    };
+
+    Uart_Send(STDOUT_BASEADDRESS, fields, sizeof(fields));
+}
+
+static void __send_consensus_trailer(unsigned num_banks)
+{
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        const consensus_result& result = consensus_results[bank];
+        __send_bank_result(result.mismatches, result.retries, result.unresolved);
+    }
+}
+
+/*
+    NOTE: With "integrity" the Game Boy global checksum, CRC-32 and SHA-1 are run over every
+          bank right before it leaves cartridge_buffer (also when the PC skips it in hashed
+          mode) and sent as the last trailer: the calculated and the header's global checksum
+          (16 bit little endian, both 0 for RAM), the CRC-32 (little endian) and the SHA-1.
+          The PC can accept or reject the dump right away without hashing it again.
+*/
+struct integrity_context
+{
+    uint32_t global_sum;
+    uint16_t global_checksum;
+    uint32_t crc;
+    sha1_context sha1;
+};
+
+static integrity_context integrity;
+
+static void __begin_integrity()
+{
+    integrity = {};
+    sha1_init(integrity.sha1);
+}
+
+// The global checksum adds up the whole ROM except for itself, it sits in the header of bank 0.
+static void __update_integrity(unsigned bank, uint16_t size, bool rom)
+{
+    STATS_PHASE_BEGIN(PHASE_HASH);
+    integrity.crc = crc32(integrity.crc, cartridge_buffer, size);
+    sha1_update(integrity.sha1, cartridge_buffer, size);
+
+    if (rom)
+    {
+        integrity.global_sum = byte_sum(integrity.global_sum, cartridge_buffer, size);
+
+        if (bank == 0)
+        {
+            const cartridge_header* header = (const cartridge_header*)&cartridge_buffer[HEADER_BASE_ADDRESS];
+
+            integrity.global_checksum = header->global_checksum[0] << 8 | header->global_checksum[1];
+            integrity.global_sum -= header->global_checksum[0] + header->global_checksum[1];
+        }
+    }
+    STATS_PHASE_END(PHASE_HASH);
+}
+
+static void __send_integrity_trailer()
+{
+    uint8_t trailer[2 + 2 + 4 + SHA1_DIGEST_SIZE];
+
+    trailer[0] = (uint8_t)integrity.global_sum;
+    trailer[1] = (uint8_t)(integrity.global_sum >> 8);
+    trailer[2] = (uint8_t)integrity.global_checksum;
+    trailer[3] = (uint8_t)(integrity.global_checksum >> 8);
+
+    for (unsigned i = 0; i < 4; ++i)
+        trailer[4 + i] = (uint8_t)(integrity.crc >> (i * 8));
+
+    sha1_final(integrity.sha1, &trailer[8]);
+
+    Uart_Send(STDOUT_BASEADDRESS, trailer, sizeof(trailer));
+}
+
+// Sends whatever follows the banks once the last one is out of cartridge_buffer.
+static void __finish_banks(unsigned num_banks, uint8_t flags)
+{
+    // The last framed bank still has to be confirmed, no trailers follow an abort.
+    if ((flags & TRANSFER_FRAMED) && !__confirm_framed_bank())
+        return;
+
+    if (flags & TRANSFER_CONSENSUS)
+        __send_consensus_trailer(num_banks);
+
+    if (flags & TRANSFER_INTEGRITY)
+        __send_integrity_trailer();
+
+    STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+    Uart_Flush();
+    STATS_PHASE_END(PHASE_UART_DRAIN);
+}
+
+// Reads ROM banks into the cartridge buffer and sends them over UART.
+template <typename Mapper>
+static void __send_rom_banks(unsigned num_banks, uint8_t flags)
+{
+    __print_response_header(response_t::OK, num_banks * ROM_BANK_SIZE);
+
+    Mapper::reset();
+
+    if (flags & TRANSFER_INTEGRITY)
+        __begin_integrity();
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        // The previous bank is sent while this one is being read.
+        STATS_PHASE_BEGIN(PHASE_BANK_READ);
+        read_rom<Mapper>(bank);
+
+        if (flags & TRANSFER_CONSENSUS)
+            verify_rom<Mapper>(bank, consensus_results[bank]);
+        STATS_PHASE_END(PHASE_BANK_READ);
+
+        if (flags & TRANSFER_INTEGRITY)
+            __update_integrity(bank, ROM_BANK_SIZE, true);
+
+        if (!__send_bank(bank, ROM_BANK_SIZE, flags))
+            return;
+    }
+
+    __finish_banks(num_banks, flags);
+}
+
+// Reads RAM banks into the cartridge buffer and sends them over UART.
+template <typename Mapper>
+static void __send_ram_banks(unsigned num_banks, uint8_t flags)
+{
+    __print_response_header(response_t::OK, num_banks * Mapper::RAM_BANK_SIZE);
+
+    Mapper::reset();
+
+    if (flags & TRANSFER_INTEGRITY)
+        __begin_integrity();
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        // The previous bank is sent while this one is being read.
+        STATS_PHASE_BEGIN(PHASE_BANK_READ);
+        read_ram<Mapper>(bank);
+
+        if (flags & TRANSFER_CONSENSUS)
+            verify_ram<Mapper>(bank, consensus_results[bank]);
+        STATS_PHASE_END(PHASE_BANK_READ);
+
+        if (flags & TRANSFER_INTEGRITY)
+            __update_integrity(bank, Mapper::RAM_BANK_SIZE, false);
+
+        if (!__send_bank(bank, Mapper::RAM_BANK_SIZE, flags))
+            return;
+    }
+
+    __finish_banks(num_banks, flags);
+}
+
+// Must match BUFFER_CHUNK_SIZE in reader.py and divide every RAM bank size.
+const unsigned RAM_WRITE_CHUNK_SIZE = 256;
+
+/*
+    NOTE: RAM writes are flow controlled with credits instead of echoing the data. The board
+          starts by granting a window of bytes the PC may send ahead. Every chunk the board
+          took in is acknowledged with its CRC-32 (little endian), which also hands the credit
+          for one more chunk back to the PC. The PC keeps the window full and checks the CRCs
+          as they come in, so the link runs at line rate in both directions.
+
+          RAM_WRITE_WINDOW is what the RX ring can hold while a bank is written to the cartridge.
+          On the PYNQ-Z2 a raw write grants a whole bank instead: the UART interrupt receives the
+          next bank into the other cartridge buffer while this one is written, and its chunks are
+          acknowledged once it is complete. The Basys3 keeps to the ring, at the fixed 115200 baud
+          of its UartLite hardly more than that arrives while a bank is written. Compressed writes
+          are decoded from the ring as they come in and keep to it on both boards.
+*/
+const unsigned RAM_WRITE_WINDOW = UART_RING_SIZE;
+
+static_assert(RAM_WRITE_WINDOW % RAM_WRITE_CHUNK_SIZE == 0, "The window has to be made of whole chunks.");
+
+static void __begin_write_window(uint32_t window)
+{
+    __send_uint32(window);
+}
+
+static void __acknowledge_write_chunk(const uint8_t* chunk)
+{
+    __send_uint32(crc32(0, chunk, RAM_WRITE_CHUNK_SIZE));
+}
+
+static void __receive_write_chunk(uint8_t* chunk)
+{
+    Uart_Recv(STDOUT_BASEADDRESS, chunk, RAM_WRITE_CHUNK_SIZE);
+    __acknowledge_write_chunk(chunk);
+}
+
+/*
+    NOTE: A compressed write first announces the size of the stream of banks, which has the
+          same format as a compressed read and is padded to a multiple of RAM_WRITE_CHUNK_SIZE.
+          The stream is acknowledged chunk by chunk like a raw write and decoded as it comes in.
+          Once a bank turns out to be corrupt nothing is written anymore, the rest of the
+          stream is drained and the final response tells the PC.
+*/
+static uint8_t stream_chunk[RAM_WRITE_CHUNK_SIZE];
+static unsigned stream_chunk_position;
+static uint32_t stream_bytes_left;
+
+// Returns false if the stream ends before length bytes were read.
+static bool __read_stream(uint8_t* data, uint32_t length)
+{
+    while (length != 0)
+    {
+        if (stream_chunk_position == RAM_WRITE_CHUNK_SIZE)
+        {
+            if (stream_bytes_left == 0)
+                return false;
+
+            __receive_write_chunk(stream_chunk);
+
+            stream_bytes_left -= RAM_WRITE_CHUNK_SIZE;
+            stream_chunk_position = 0;
+        }
+
+        uint32_t count = RAM_WRITE_CHUNK_SIZE - stream_chunk_position;
+        if (count > length)
+            count = length;
+
+        memcpy(data, &stream_chunk[stream_chunk_position], count);
+
+        stream_chunk_position += count;
+        data += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+// Reads the next bank of the stream into cartridge_buffer, returns false if it is corrupt.
+static bool __read_stream_bank(uint16_t bank_size)
+{
+    uint8_t bank_header[3];
+    if (!__read_stream(bank_header, sizeof(bank_header)))
+        return false;
+
+    uint16_t size = bank_header[1] | bank_header[2] << 8;
+
+    switch (bank_header[0])
+    {
+        case BANK_RAW:
+            return size == bank_size && __read_stream(cartridge_buffer, size);
+
+        case BANK_COMPRESSED:
+        {
+            uint8_t* spare_buffer = get_spare_cartridge_buffer();
+
+            if (size >= bank_size || !__read_stream(spare_buffer, size))
+                return false;
+
+            STATS_PHASE_BEGIN(PHASE_COMPRESSION);
+            bool valid = decompress_bank(spare_buffer, size, cartridge_buffer, bank_size);
+            STATS_PHASE_END(PHASE_COMPRESSION);
+
+            return valid;
+        }
+
+        default:
+            return false;
+    }
+}
+
+/*
+    NOTE: In delta mode only the bytes that differ from the cartridge are written (see write_ram_delta)
+          and their number follows the transfer as 32 bit little endian.
+
+    NOTE: In verify mode every bank is read back right after it was written and the bytes that
+          did not stick are written again (see verify_written_ram). Only the verify_result of
+          every bank goes to the PC (mismatches, rewrites and unresolved bytes, 16 bit little
+          endian each), as the very last part of the transfer.
+*/
+static uint32_t delta_bytes_written;
+
+const unsigned MAX_RAM_BANKS = 16;
+static verify_result verify_results[MAX_RAM_BANKS];
+
+template <typename Mapper>
+static void __write_ram_bank(unsigned bank, uint8_t flags)
+{
+    STATS_PHASE_BEGIN(PHASE_BANK_WRITE);
+    if (flags & TRANSFER_DELTA)
+        delta_bytes_written += write_ram_delta<Mapper>(bank);
+    else
+        write_ram<Mapper>(bank);
+
+    if (flags & TRANSFER_VERIFY)
+        verify_written_ram<Mapper>(bank, verify_results[bank]);
+    STATS_PHASE_END(PHASE_BANK_WRITE);
+}
+
+static void __send_verify_trailer(unsigned num_banks)
+{
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        const verify_result& result = verify_results[bank];
+        __send_bank_result(result.mismatches, result.rewrites, result.unresolved);
+    }
+}
+
+template <typename Mapper>
+static void __receive_compressed_ram_banks(unsigned num_banks, uint8_t flags)
+{
+    uint32_t stream_size = __receive_uint32();
+
+    // Every bank may be sent raw with its header.
+    uint32_t max_stream_size = num_banks * (3 + Mapper::RAM_BANK_SIZE) + RAM_WRITE_CHUNK_SIZE - 1;
+
+    if (stream_size == 0 || stream_size % RAM_WRITE_CHUNK_SIZE != 0 || stream_size > max_stream_size)
+    {
+        __print_response_header(response_t::INVALID_RAM_WRITE_SIZE);
+        return;
+    }
+
+    __print_response_header(response_t::OK);
+    __begin_write_window(RAM_WRITE_WINDOW);
+
+    stream_chunk_position = RAM_WRITE_CHUNK_SIZE;
+    stream_bytes_left = stream_size;
+
+    bool valid = true;
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        valid = __read_stream_bank(Mapper::RAM_BANK_SIZE);
+        if (!valid)
+            break;
+
+        __write_ram_bank<Mapper>(bank, flags);
+    }
+
+    // Whatever is left is padding or follows a corrupt bank.
+    while (stream_bytes_left != 0)
+    {
+        __receive_write_chunk(stream_chunk);
+        stream_bytes_left -= RAM_WRITE_CHUNK_SIZE;
+    }
+
+    __print_response_header(valid ? response_t::OK : response_t::INVALID_COMPRESSED_DATA);
+}
+
+template <typename Mapper>
+static void __receive_raw_ram_banks(unsigned num_banks, uint8_t flags)
+{
+#ifdef __riscv
+    __begin_write_window(RAM_WRITE_WINDOW);
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        // The PC keeps sending the next bank into the RX ring while this one is written.
+        for (unsigned address = 0; address < Mapper::RAM_BANK_SIZE; address += RAM_WRITE_CHUNK_SIZE)
+            __receive_write_chunk(&cartridge_buffer[address]);
+
+        __write_ram_bank<Mapper>(bank, flags);
+    }
+#else
+    static_assert(Mapper::RAM_BANK_SIZE % RAM_WRITE_CHUNK_SIZE == 0, "A bank has to be made of whole chunks.");
+
+    __begin_write_window(Mapper::RAM_BANK_SIZE);
+    Uart_QueueRecv(STDOUT_BASEADDRESS, cartridge_buffer, Mapper::RAM_BANK_SIZE);
+
+    for (unsigned bank = 0; bank < num_banks; ++bank)
+    {
+        Uart_WaitRecv();
+
+        // The credit for the whole next bank goes back before this one is written, so the PC can send it meanwhile.
+        if (bank + 1 < num_banks)
+            Uart_QueueRecv(STDOUT_BASEADDRESS, get_other_cartridge_buffer(), Mapper::RAM_BANK_SIZE);
+
+        for (unsigned address = 0; address < Mapper::RAM_BANK_SIZE; address += RAM_WRITE_CHUNK_SIZE)
+            __acknowledge_write_chunk(&cartridge_buffer[address]);
+
+        __write_ram_bank<Mapper>(bank, flags);
+        swap_cartridge_buffers();
+    }
+#endif
+}
+
+// Receives RAM banks over UART and writes them to the cartridge.
+template <typename Mapper>
+static void __receive_ram_banks(unsigned num_banks, uint8_t flags)
+{
+    // How many bytes wants the PC to write?
+    uint32_t write_size = __receive_uint32();
 
-    if (payload_size > 0)
+    if (write_size != num_banks * Mapper::RAM_BANK_SIZE)
     {
-        for (unsigned i = 0; i < 4; ++i)
-            Uart_SendByte(STDOUT_BASEADDRESS, (uint8_t)(payload_size >> (i * 8)));
+        __print_response_header(response_t::INVALID_RAM_WRITE_SIZE);
+        return;
+    }
+
+    __print_response_header(response_t::OK);
+
+    Mapper::reset();
+
+    delta_bytes_written = 0;
+    memset(verify_results, 0, sizeof(verify_results));
+
+    if (flags & TRANSFER_COMPRESSED)
+        __receive_compressed_ram_banks<Mapper>(num_banks, flags);
+    else
+        __receive_raw_ram_banks<Mapper>(num_banks, flags);
+
+    if (flags & TRANSFER_DELTA)
+        __send_uint32(delta_bytes_written);
+
+    if (flags & TRANSFER_VERIFY)
+        __send_verify_trailer(num_banks);
+}
+
+// Returns OK and the number of RAM banks the header announces, MBC2 counts as a single bank.
+static response_t __count_ram_banks(const cartridge_header* header, unsigned& num_banks)
+{
+    num_banks = 0;
+
+    switch (header->ram_size)
+    {
+        case 0x00:
+            // MBC2 carts have RAM built into the MBC which is handled as a single bank.
+            if (header->cartridge_type == cartridge_type::MBC2
+                || header->cartridge_type == cartridge_type::MBC2_BATTERY)
+            {
+                num_banks = 1;
+                return response_t::OK;
+            }
+
+            return response_t::CARTRIDGE_HAS_NO_RAM;
+
+        case 0x02: num_banks = 1; return response_t::OK;
+        case 0x03: num_banks = 4; return response_t::OK;
+        case 0x04: num_banks = 16; return response_t::OK;
+        case 0x05: num_banks = 8; return response_t::OK;
+
+        default:
+            return response_t::INVALID_NUM_RAM_BANKS;
+    }
+}
+
+/*
+    NOTE: "read range" takes up to MAX_RANGE_REGIONS regions of <rom|ram> <bank> <offset> <length>,
+          numbers in decimal or 0x hex, e.g. "read range rom 5 0x3f00 0x100 ram 0 0 16".
+          A region has to stay inside its bank. The regions are read in the order they were
+          given and their data is sent back to back behind a single response header.
+*/
+const unsigned MAX_RANGE_REGIONS = 8;
+
+struct range_region
+{
+    bool ram;
+    uint16_t bank;
+    uint16_t offset;
+    uint16_t length;
+};
+
+// Parses the next space separated number and moves arguments past it.
+static bool __parse_number(const char*& arguments, uint32_t& value)
+{
+    char* end;
+    value = strtoul(arguments, &end, 0);
+
+    if (end == arguments || (*end != ' ' && *end != '\0'))
+        return false;
+
+    arguments = *end == ' ' ? end + 1 : end;
+    return true;
+}
+
+static bool __parse_range_regions(const char* arguments, range_region* regions, unsigned& num_regions)
+{
+    num_regions = 0;
+
+    while (*arguments != '\0')
+    {
+        if (num_regions == MAX_RANGE_REGIONS)
+            return false;
+
+        range_region& region = regions[num_regions++];
+
+        if (!strncmp(arguments, "rom ", 4))
+            region.ram = false;
+        else if (!strncmp(arguments, "ram ", 4))
+            region.ram = true;
+        else
+            return false;
+
+        arguments += 4;
+
+        uint32_t bank, offset, length;
+        if (!__parse_number(arguments, bank) || !__parse_number(arguments, offset) || !__parse_number(arguments, length))
+            return false;
+
+        // The bank sizes are checked once the cartridge is known, this only keeps the sums from overflowing.
+        if (bank > 0xffff || offset > ROM_BANK_SIZE || length == 0 || length > ROM_BANK_SIZE)
+            return false;
+
+        region.bank = bank;
+        region.offset = offset;
+        region.length = length;
+    }
+
+    return num_regions > 0;
+}
+
+template <typename Mapper>
+static void __send_range_regions(const range_region* regions, unsigned num_regions, unsigned num_rom_banks, unsigned num_ram_banks, response_t ram_response)
+{
+    uint32_t payload_size = 0;
+
+    for (unsigned i = 0; i < num_regions; ++i)
+    {
+        const range_region& region = regions[i];
+
+        if (region.ram && ram_response != response_t::OK)
+        {
+            __print_response_header(ram_response);
+            return;
+        }
+
+        unsigned num_banks = region.ram ? num_ram_banks : num_rom_banks;
+        uint16_t bank_size = region.ram ? Mapper::RAM_BANK_SIZE : ROM_BANK_SIZE;
+
+        if (region.bank >= num_banks || region.offset + region.length > bank_size)
+        {
+            __print_response_header(response_t::INVALID_ARGUMENTS);
+            return;
+        }
+
+        payload_size += region.length;
+    }
+
+    __print_response_header(response_t::OK, payload_size);
+
+    Mapper::reset();
+
+    for (unsigned i = 0; i < num_regions; ++i)
+    {
+        const range_region& region = regions[i];
+
+        // The previous region is sent while this one is being read.
+        STATS_PHASE_BEGIN(PHASE_BANK_READ);
+        if (region.ram)
+            read_ram<Mapper>(region.bank, region.offset, region.length);
+        else
+            read_rom<Mapper>(region.bank, region.offset, region.length);
+        STATS_PHASE_END(PHASE_BANK_READ);
+
+        __queue_bank(region.length, false);
     }
+
+    STATS_PHASE_BEGIN(PHASE_UART_DRAIN);
+    Uart_Flush();
+    STATS_PHASE_END(PHASE_UART_DRAIN);
 }
 
+
 void cli_unknown()
 {
     __print_response_header(response_t::UNKNOWN_COMMAND);
 }
 
-void cli_help()
+void cli_invalid_arguments()
+{
+    __print_response_header(response_t::INVALID_ARGUMENTS);
+}
+
+void cli_help(const char*)
 {
     static const char help_string[] =
         "ZYNQ GBCartReader - Read & Write Gameboy cartridges\r\n"
@@ -40,6 +974,18 @@ void cli_help()
         "read rom      Read cartridge rom and echo it in binary\r\n"
         "read ram      Read cartridge ram (if available) and echo it in binary\r\n"
         "write ram     Write cartridge ram (if available) from binary terminal data\r\n"
+        "              (add \"compressed\" to the three above for per bank compression)\r\n"
+        "              (add \"hashed\" to the reads to let the host skip banks it knows)\r\n"
+        "              (add \"framed\" to the reads for CRC checked frames with resending)\r\n"
+        "              (add \"consensus\" to the reads to re-read and vote on unstable bytes)\r\n"
+        "              (add \"integrity\" to the reads for global checksum, CRC-32 and SHA-1)\r\n"
+        "              (add \"delta\" to write ram to only write bytes that differ)\r\n"
+        "              (add \"verify\" to write ram to read back and rewrite what did not stick)\r\n"
+        "read range    Read up to 8 regions of <rom|ram> <bank> <offset> <length> in binary\r\n"
+        "burst on      Hold RDn/CSn asserted while reading a whole bank (default)\r\n"
+        "burst off     Strobe RDn/CSn for every byte read (for misbehaving cartridges)\r\n"
+        "calibrate     Find the fastest reliable bus timing for the inserted cartridge\r\n"
+        "baud <rate>   Switch the UART baud rate (the host has to confirm the new rate)\r\n"
     ;
 
     __print_response_header(response_t::OK, sizeof(help_string) - 1);
@@ -47,9 +993,9 @@ void cli_help()
 }
 
 // Parses and outputs the cartridge header in human readable format.
-void cli_parse_header()
+void cli_parse_header(const char*)
 {
-    // All MBCs power up in such a state that mbc1::read_rom(0) will read the first bank
+    // All MBCs power up in such a state that read_rom<mbc1::mapper>(0) will read the first bank
     // which contains the header for further identification (when reading other banks or RAM).
     // To speed things up mbc1::read_header only reads the range where the header actually sits
     // instead of the whole bank 0.
@@ -162,9 +1108,7 @@ void cli_parse_header()
     xil_sprintf(&header_string, "  Version:           %02x\r\n", header->rom_version);
 
 
-    uint8_t calculated_checksum = 0;
-    for (uint16_t address = 4 + 48; address < sizeof(cartridge_header) - 2 - 1; ++address)
-        calculated_checksum -= cartridge_buffer[HEADER_BASE_ADDRESS + address] + 1;
+    uint8_t calculated_checksum = __calculate_header_checksum(header);
 
     if (header->header_checksum == calculated_checksum)
         xil_sprintf(&header_string, "  Header Checksum:   %02x (Good)\r\n", header->header_checksum);
@@ -193,11 +1137,19 @@ void cli_parse_header()
     xil_printf("%s", header_string_base);
 }
 
-void cli_read_rom()
+void cli_read_rom(const char* arguments)
 {
+    uint8_t flags;
+    if (!__parse_transfer_flags(arguments, TRANSFER_COMPRESSED | TRANSFER_HASHED | TRANSFER_FRAMED | TRANSFER_CONSENSUS | TRANSFER_INTEGRITY, flags))
+    {
+        __print_response_header(response_t::INVALID_ARGUMENTS);
+        return;
+    }
+
     cartridge_header* header = mbc1::read_header();
 
     uint8_t cartridge_type = header->cartridge_type;
+    select_timing_profile(header);
     unsigned num_banks = 1 << (header->rom_size + 1);
 
     if (header->rom_size > 0x08)
@@ -206,87 +1158,35 @@ void cli_read_rom()
         return;
     }
 
-    for (unsigned bank = 0; bank < num_banks; ++bank)
-    {
-        switch (cartridge_type)
-        {
-            // Even though the ROM-only has no MBC and therefore no registers,
-            // we can simply use the MBC1 methods as the register writes will
-            // not cause any harm since the WRn pin is unconnected on these cartridges.
-            case cartridge_type::ROM:
-
-            case cartridge_type::MBC1:
-            case cartridge_type::MBC1_RAM:
-            case cartridge_type::MBC1_RAM_BATTERY:
-                mbc1::read_rom(bank);
-                break;
-
-            case cartridge_type::MBC2:
-            case cartridge_type::MBC2_BATTERY:
-                mbc2::read_rom(bank);
-                break;
-
-            case cartridge_type::MBC3:
-            case cartridge_type::MBC3_RAM:
-            case cartridge_type::MBC3_RAM_BATTERY:
-            case cartridge_type::MBC3_RTC_BATTERY:
-            case cartridge_type::MBC3_RTC_RAM_BATTERY:
-                mbc3::read_rom(bank);
-                break;
-
-            case cartridge_type::MBC5:
-            case cartridge_type::MBC5_RAM:
-            case cartridge_type::MBC5_RAM_BATTERY:
-            case cartridge_type::MBC5_RUMBLE:
-            case cartridge_type::MBC5_RUMBLE_RAM:
-            case cartridge_type::MBC5_RUMBLE_RAM_BATTERY:
-                mbc5::read_rom(bank);
-                break;
-
-            default:
-                __print_response_header(response_t::INVALID_CARTRIDGE_TYPE);
-                return;
-        }
-
-        if (bank == 0)
-        {
-            uint32_t bytes_to_send = num_banks * ROM_BANK_SIZE;
-            __print_response_header(response_t::OK, bytes_to_send);
-        }
+    bool supported = dispatch_rom_mapper(cartridge_type, [&](auto mapper) {
+        __send_rom_banks<decltype(mapper)>(num_banks, flags);
+    });
 
-        for (unsigned address = 0; address < ROM_BANK_SIZE; ++address)
-            Uart_SendByte(STDOUT_BASEADDRESS, cartridge_buffer[address]);
-    }
+    if (!supported)
+        __print_response_header(response_t::INVALID_CARTRIDGE_TYPE);
 }
 
-void cli_read_ram()
+void cli_read_ram(const char* arguments)
 {
-    cartridge_header* header = mbc1::read_header();
-
-    uint8_t cartridge_type = header->cartridge_type;
-    unsigned num_banks = 0;
-
-    switch (header->ram_size)
+    uint8_t flags;
+    if (!__parse_transfer_flags(arguments, TRANSFER_COMPRESSED | TRANSFER_HASHED | TRANSFER_FRAMED | TRANSFER_CONSENSUS | TRANSFER_INTEGRITY, flags))
     {
-        // TODO: Handle MBC2 which has num_banks = 0 but includes 512x4b in the mapper.
+        __print_response_header(response_t::INVALID_ARGUMENTS);
+        return;
+    }
 
-        case 0x00:
-            // MBC2 carts have RAM built into the MBC.
-            if (cartridge_type == cartridge_type::MBC2
-                || cartridge_type == cartridge_type::MBC2_BATTERY)
-                break;
+    cartridge_header* header = mbc1::read_header();
 
-            __print_response_header(response_t::CARTRIDGE_HAS_NO_RAM);
-            return;
+    uint8_t cartridge_type = header->cartridge_type;
+    select_timing_profile(header);
 
-        case 0x02: num_banks = 1; break;
-        case 0x03: num_banks = 4; break;
-        case 0x04: num_banks = 16; break;
-        case 0x05: num_banks = 8; break;
+    unsigned num_banks;
+    response_t response = __count_ram_banks(header, num_banks);
 
-        default:
-            __print_response_header(response_t::INVALID_NUM_RAM_BANKS);
-            return;
+    if (response != response_t::OK)
+    {
+        __print_response_header(response);
+        return;
     }
 
     /* NOTE: We don't sanity check based on the different configurations and assume the ROM is good.
@@ -294,169 +1194,347 @@ void cli_read_ram()
              There's way too much variety to cover and it would unnecessarily bloat up the code
              since official cartridges are required to meet the specification. */
 
-    // Handle MBC2 separately as it has internal RAM
-    if (cartridge_type == cartridge_type::MBC2 || cartridge_type == cartridge_type::MBC2_BATTERY)
-    {
-        mbc2::read_ram();
+    bool supported = dispatch_ram_mapper(cartridge_type, [&](auto mapper) {
+        __send_ram_banks<decltype(mapper)>(num_banks, flags);
+    });
 
-        __print_response_header(response_t::OK, INTERNAL_RAM_SIZE);
+    if (!supported)
+        __print_response_header(response_t::INVALID_CARTRIDGE_TYPE);
+}
 
-        for (unsigned address = 0; address < INTERNAL_RAM_SIZE; ++address)
-            Uart_SendByte(STDOUT_BASEADDRESS, cartridge_buffer[address]);
+// Reads the given regions of ROM and RAM banks, see __parse_range_regions for the syntax.
+void cli_read_range(const char* arguments)
+{
+    range_region regions[MAX_RANGE_REGIONS];
+    unsigned num_regions;
 
+    if (!__parse_range_regions(arguments, regions, num_regions))
+    {
+        __print_response_header(response_t::INVALID_ARGUMENTS);
         return;
     }
 
-    for (unsigned bank = 0; bank < num_banks; ++bank)
-    {
-        switch (cartridge_type)
-        {
-            case cartridge_type::MBC1_RAM:
-            case cartridge_type::MBC1_RAM_BATTERY:
-                mbc1::read_ram(bank);
-                break;
-
-            case cartridge_type::MBC3_RAM:
-            case cartridge_type::MBC3_RAM_BATTERY:
-            case cartridge_type::MBC3_RTC_RAM_BATTERY:
-                mbc3::read_ram(bank);
-                break;
-
-            case cartridge_type::MBC5_RAM:
-            case cartridge_type::MBC5_RAM_BATTERY:
-
-            // Bit 3 of RAMB controls the rumble motor on these cartridges but since
-            // the cartridge will not have so many banks to accidentally trigger the rumble
-            // this works just as well.
-            case cartridge_type::MBC5_RUMBLE_RAM:
-            case cartridge_type::MBC5_RUMBLE_RAM_BATTERY:
-                mbc5::read_ram(bank);
-                break;
-
-            default:
-                __print_response_header(response_t::INVALID_CARTRIDGE_TYPE);
-                return;
-        }
+    cartridge_header* header = mbc1::read_header();
 
-        if (bank == 0)
-        {
-            uint32_t bytes_to_write = num_banks * RAM_BANK_SIZE;
-            __print_response_header(response_t::OK, bytes_to_write);
-        }
+    uint8_t cartridge_type = header->cartridge_type;
+    select_timing_profile(header);
+    unsigned num_rom_banks = 1 << (header->rom_size + 1);
 
-        for (unsigned address = 0; address < RAM_BANK_SIZE; ++address)
-            Uart_SendByte(STDOUT_BASEADDRESS, cartridge_buffer[address]);
+    if (header->rom_size > 0x08)
+    {
+        __print_response_header(response_t::INVALID_NUM_ROM_BANKS);
+        return;
     }
-}
 
-void cli_write_ram()
-{
-    cartridge_header* header = mbc1::read_header();
-    uint8_t cartridge_type = header->cartridge_type;
+    unsigned num_ram_banks;
+    response_t ram_response = __count_ram_banks(header, num_ram_banks);
 
-    // This comes in handy to collapse multiple for-loops into one.
-    void (*write_func)(uint8_t bank);
+    if (!dispatch_ram_mapper(cartridge_type, [](auto) {}))
+        ram_response = response_t::CARTRIDGE_HAS_NO_RAM;
 
-    switch (cartridge_type)
-    {
-        case cartridge_type::MBC1_RAM:
-        case cartridge_type::MBC1_RAM_BATTERY:
-            write_func = mbc1::write_ram;
-            break;
+    bool supported = dispatch_rom_mapper(cartridge_type, [&](auto mapper) {
+        __send_range_regions<decltype(mapper)>(regions, num_regions, num_rom_banks, num_ram_banks, ram_response);
+    });
 
-        case cartridge_type::MBC2:
-        case cartridge_type::MBC2_BATTERY:
-            break;
+    if (!supported)
+        __print_response_header(response_t::INVALID_CARTRIDGE_TYPE);
+}
 
-        case cartridge_type::MBC3_RAM:
-        case cartridge_type::MBC3_RAM_BATTERY:
-        case cartridge_type::MBC3_RTC_RAM_BATTERY:
-            write_func = mbc3::write_ram;
-            break;
+void cli_write_ram(const char* arguments)
+{
+    uint8_t flags;
+    if (!__parse_transfer_flags(arguments, TRANSFER_COMPRESSED | TRANSFER_DELTA | TRANSFER_VERIFY, flags))
+    {
+        __print_response_header(response_t::INVALID_ARGUMENTS);
+        return;
+    }
 
-        case cartridge_type::MBC5_RAM:
-        case cartridge_type::MBC5_RAM_BATTERY:
-        case cartridge_type::MBC5_RUMBLE_RAM:
-        case cartridge_type::MBC5_RUMBLE_RAM_BATTERY:
-            write_func = mbc5::write_ram;
-            break;
+    cartridge_header* header = mbc1::read_header();
+    uint8_t cartridge_type = header->cartridge_type;
 
-        default:
-            __print_response_header(response_t::CARTRIDGE_HAS_NO_RAM);
-            return;
-    }
+    // The calibrated scale was only verified for reads, the write strobes keep the full profile.
+    select_timing_profile(header, 100);
 
-    uint8_t num_banks = 0;
+    // Unknown RAM sizes are only reported once the cartridge is known to have RAM.
+    unsigned num_banks = 0;
 
     switch (header->ram_size)
     {
         case 0x00:
-            // MBC2 carts have RAM built into the MBC.
+            // MBC2 carts have RAM built into the MBC which is handled as a single bank.
             if (cartridge_type == cartridge_type::MBC2
                 || cartridge_type == cartridge_type::MBC2_BATTERY)
-                break;
-            else
-            {
-                __print_response_header(response_t::INVALID_NUM_RAM_BANKS);
-                return;
-            }
+                num_banks = 1;
+            break;
 
         case 0x02: num_banks = 1; break;
         case 0x03: num_banks = 4; break;
         case 0x04: num_banks = 16; break;
         case 0x05: num_banks = 8; break;
+    }
 
-        default:
+    bool supported = dispatch_ram_mapper(cartridge_type, [&](auto mapper) {
+        if (num_banks == 0)
+        {
             __print_response_header(response_t::INVALID_NUM_RAM_BANKS);
             return;
+        }
+
+        __print_response_header(response_t::OK);
+        __receive_ram_banks<decltype(mapper)>(num_banks, flags);
+    });
+
+    if (!supported)
+        __print_response_header(response_t::CARTRIDGE_HAS_NO_RAM);
+}
+
+void cli_burst_on(const char*)
+{
+    bus_burst_reads = true;
+    __print_response_header(response_t::OK);
+}
+
+void cli_burst_off(const char*)
+{
+    bus_burst_reads = false;
+    __print_response_header(response_t::OK);
+}
+
+/*
+    Switches the UART to the baud rate passed as argument. The response is still sent with
+    the old rate, then both ends switch and the host has to prove that the link works:
+    host sends BAUD_HANDSHAKE_REQUEST, board answers BAUD_HANDSHAKE_ACK, host confirms
+    with BAUD_HANDSHAKE_CONFIRM. If any of it does not arrive in time, the board falls back
+    to the default rate (the host does the same) so it never ends up unreachable.
+*/
+const uint8_t BAUD_HANDSHAKE_REQUEST = 0xa5;
+const uint8_t BAUD_HANDSHAKE_ACK = 0x5a;
+const uint8_t BAUD_HANDSHAKE_CONFIRM = 0xc3;
+const uint32_t BAUD_HANDSHAKE_TIMEOUT_US = 1000000;
+
+void cli_baud(const char* arguments)
+{
+    char* end;
+    uint32_t baud_rate = strtoul(arguments, &end, 10);
+
+    if (end == arguments || *end != '\0')
+    {
+        __print_response_header(response_t::INVALID_ARGUMENTS);
+        return;
+    }
+
+    if (!Uart_IsBaudRateSupported(baud_rate))
+    {
+        __print_response_header(response_t::UNSUPPORTED_BAUD_RATE);
+        return;
     }
 
     __print_response_header(response_t::OK);
 
-    // How many bytes wants the PC to write?
-    uint32_t write_size = 0;
-    for (int i = 0; i < 4; ++i)
-        write_size |= ((uint32_t)Uart_RecvByte(STDOUT_BASEADDRESS)) << (i * 8);
+    Uart_SetBaudRate(STDOUT_BASEADDRESS, baud_rate);
+
+    uint8_t handshake;
 
-    // Handle MBC2 separately as it as internal RAM.
-    if (cartridge_type == cartridge_type::MBC2 || cartridge_type == cartridge_type::MBC2_BATTERY)
+    if (Uart_RecvByteTimeout(STDOUT_BASEADDRESS, &handshake, BAUD_HANDSHAKE_TIMEOUT_US)
+        && handshake == BAUD_HANDSHAKE_REQUEST)
     {
-        if (write_size != INTERNAL_RAM_SIZE)
-        {
-            __print_response_header(response_t::INVALID_RAM_WRITE_SIZE);
-            return;
-        }
+        Uart_SendByte(STDOUT_BASEADDRESS, BAUD_HANDSHAKE_ACK);
 
-        __print_response_header(response_t::OK);
+        if (Uart_RecvByteTimeout(STDOUT_BASEADDRESS, &handshake, BAUD_HANDSHAKE_TIMEOUT_US)
+            && handshake == BAUD_HANDSHAKE_CONFIRM)
+            return;
+    }
 
-        for (unsigned address = 0; address < INTERNAL_RAM_SIZE; ++address)
-        {
-            uint8_t byte = Uart_RecvByte(STDOUT_BASEADDRESS);
-            cartridge_buffer[address] = byte;
-            Uart_SendByte(STDOUT_BASEADDRESS, byte);
-        }
+    Uart_SetBaudRate(STDOUT_BASEADDRESS, Uart_GetDefaultBaudRate());
+}
 
-        mbc2::write_ram();
-        return;
+#ifdef INSTRUMENTATION
+// Outputs the instrumentation counters collected since the last call and resets them.
+void cli_stats(const char*)
+{
+    static const char* phase_names[NUM_STATS_PHASES] = {
+        "Header read:  ",
+        "Bank switch:  ",
+        "Bank read:    ",
+        "Bank write:   ",
+        "UART drain:   ",
+        "Compression:  ",
+        "Hashing:      ",
+    };
+
+    // See cli_parse_header for why the cartridge buffer is used.
+    char* stats_string = (char*)&cartridge_buffer[0x1000];
+    char* stats_string_base = stats_string;
+
+    xil_sprintf(&stats_string, "Counters:\r\n");
+    xil_sprintf(&stats_string, "  GPIO writes:         %u\r\n", stats.gpio_writes);
+    xil_sprintf(&stats_string, "  GPIO writes elided:  %u\r\n", stats.gpio_writes_elided);
+    xil_sprintf(&stats_string, "  GPIO reads:          %u\r\n", stats.gpio_reads);
+    xil_sprintf(&stats_string, "  Delay time:          %u us\r\n", ticks_to_us(stats.delay_ticks));
+    xil_sprintf(&stats_string, "  Register writes:     %u\r\n", stats.register_writes);
+    xil_sprintf(&stats_string, "  Reg. writes elided:  %u\r\n", stats.register_writes_elided);
+    xil_sprintf(&stats_string, "  UART bytes sent:     %u\r\n", stats.uart_bytes_sent);
+    xil_sprintf(&stats_string, "  UART bytes received: %u\r\n", stats.uart_bytes_received);
+    xil_sprintf(&stats_string, "  UART stall time:     %u us\r\n", ticks_to_us(stats.uart_stall_ticks));
+    xil_sprintf(&stats_string, "\r\n");
+
+    xil_sprintf(&stats_string, "Phases:\r\n");
+    for (unsigned phase = 0; phase < NUM_STATS_PHASES; ++phase)
+    {
+        xil_sprintf(
+            &stats_string, "  %s%u us (%u times)\r\n",
+            phase_names[phase], ticks_to_us(stats.phase_ticks[phase]), stats.phase_count[phase]
+        );
     }
 
-    if (write_size != num_banks * RAM_BANK_SIZE)
+    stats = {};
+
+    __print_response_header(response_t::OK, (uint32_t)(stats_string - stats_string_base));
+    xil_printf("%s", stats_string_base);
+}
+#endif
+
+/*
+    Steps the bus delays of the cartridge's timing profile down and keeps the fastest
+    setting that still reads the cartridge reliably, plus a safety margin. A setting is
+    reliable if the header (logo, checksum) and a couple of samples across bank 0 read
+    back identical to what was read with the conservative timing, several times in a row.
+*/
+void cli_calibrate(const char*)
+{
+    // In percent of the cartridge's timing profile, from slowest to fastest.
+    static const uint8_t scales[] = { 200, 150, 100, 75, 50, 35, 25, 15, 10, 5, 0 };
+    static const uint16_t sample_addresses[] = { 0x0000, 0x0150, 0x1000, 0x2000, 0x3fc0 };
+
+    const uint16_t SAMPLE_SIZE = 64;
+    const unsigned NUM_REPETITIONS = 3;
+    const uint8_t SAFETY_MARGIN = 25;
+
+    cartridge_header* header = mbc1::read_header();
+    clear_timing_calibration();
+
+    if (!__is_header_valid(header))
     {
-        __print_response_header(response_t::INVALID_RAM_WRITE_SIZE);
+        __print_response_header(response_t::INVALID_HEADER);
         return;
     }
 
-    __print_response_header(response_t::OK);
+    cartridge_header reference_header;
+    memcpy(&reference_header, header, sizeof(cartridge_header));
 
-    for (unsigned bank = 0; bank < num_banks; ++bank)
+    // The header was read with the conservative timing which is still active.
+    uint8_t* reference = &cartridge_buffer[0x1000];
+    uint8_t* samples = &cartridge_buffer[0x2000];
+
+    for (unsigned i = 0; i < arraysizeof(sample_addresses); ++i)
+        mbc1::read_rom_range(sample_addresses[i], &reference[i * SAMPLE_SIZE], SAMPLE_SIZE);
+
+    int fastest_step = -1;
+
+    for (unsigned step = 0; step < arraysizeof(scales); ++step)
     {
-        for (unsigned address = 0; address < RAM_BANK_SIZE; ++address)
+        select_timing_profile(&reference_header, scales[step]);
+
+        bool reliable = true;
+
+        for (unsigned repetition = 0; reliable && repetition < NUM_REPETITIONS; ++repetition)
         {
-            uint8_t byte = Uart_RecvByte(STDOUT_BASEADDRESS);
-            cartridge_buffer[address] = byte;
-            Uart_SendByte(STDOUT_BASEADDRESS, byte);
+            mbc1::read_rom_range(HEADER_BASE_ADDRESS, samples, sizeof(cartridge_header));
+            reliable = !memcmp(samples, &reference_header, sizeof(cartridge_header));
+
+            for (unsigned i = 0; reliable && i < arraysizeof(sample_addresses); ++i)
+            {
+                mbc1::read_rom_range(sample_addresses[i], samples, SAMPLE_SIZE);
+                reliable = !memcmp(samples, &reference[i * SAMPLE_SIZE], SAMPLE_SIZE);
+            }
         }
 
-        write_func(bank);
+        // Assume that once a setting fails, all faster ones would fail as well.
+        if (!reliable) break;
+
+        fastest_step = step;
+    }
+
+    if (fastest_step < 0)
+    {
+        __print_response_header(response_t::CALIBRATION_FAILED);
+        return;
+    }
+
+    uint8_t fastest_scale = scales[fastest_step];
+    uint8_t calibrated_scale = (fastest_scale + SAFETY_MARGIN > 255) ? 255 : fastest_scale + SAFETY_MARGIN;
+
+    set_timing_calibration(&reference_header, calibrated_scale);
+    select_timing_profile(&reference_header);
+
+    // See cli_parse_header for why the cartridge buffer is used.
+    char* calibration_string = (char*)&cartridge_buffer[0x1000];
+    char* calibration_string_base = calibration_string;
+
+    xil_sprintf(&calibration_string, "Profile:          %s\r\n", get_timing_profile()->name);
+    xil_sprintf(&calibration_string, "Fastest reliable: %u%%\r\n", fastest_scale);
+    xil_sprintf(&calibration_string, "Calibrated to:    %u%%\r\n", calibrated_scale);
+
+    __print_response_header(response_t::OK, (uint32_t)(calibration_string - calibration_string_base));
+    xil_printf("%s", calibration_string_base);
+}
+
+#ifdef CAPTURE
+/*
+    Sends the records of the last capture. The payload starts with the timer ticks per
+    microsecond, the number of records and the number of records that were dropped
+    because the buffer was full, so python/vcd.py can reconstruct the timing and tell
+    when the capture is incomplete.
+*/
+static void __send_capture()
+{
+    capture_disarm();
+
+    __print_response_header(response_t::OK, 12 + capture_index * sizeof(CaptureRecord));
+    __send_uint32(ns_to_ticks(1000));
+    __send_uint32(capture_index);
+    __send_uint32(capture_dropped);
+
+    Uart_Send(STDOUT_BASEADDRESS, (const uint8_t*)capture_buffer, capture_index * sizeof(CaptureRecord));
+}
+
+// Captures the PMOD lines while reading the cartridge header.
+void cli_capture_header(const char*)
+{
+    capture_arm();
+    mbc1::read_header();
+    __send_capture();
+}
+
+/*
+    A whole ROM bank takes about 16K * 44 records (36 GPIO writes and 8 reads per byte), which
+    not even the PYNQ-Z2 buffer holds. Only the start of the bank is read, sized so that the
+    bytes and the register writes of the bank switch fit in the buffer with room to spare.
+*/
+const uint16_t CAPTURE_BANK_BYTES = CAPTURE_BUFFER_SIZE / 64;
+
+// Captures the PMOD lines while reading the start of ROM bank 1 with the timing profile of the cartridge.
+void cli_capture_bank(const char*)
+{
+    cartridge_header* header = mbc1::read_header();
+
+    uint8_t cartridge_type = header->cartridge_type;
+    select_timing_profile(header);
+
+    capture_arm();
+
+    bool supported = dispatch_rom_mapper(cartridge_type, [](auto mapper) {
+        decltype(mapper)::reset();
+        read_rom<decltype(mapper)>(1, 0, CAPTURE_BANK_BYTES);
+    });
+
+    if (!supported)
+    {
+        capture_disarm();
+        __print_response_header(response_t::INVALID_CARTRIDGE_TYPE);
+        return;
     }
+
+    __send_capture();
 }
+#endif
@@ -12,17 +12,79 @@ enum response_t: uint8_t
     INVALID_NUM_ROM_BANKS   = 10,
     INVALID_NUM_RAM_BANKS   = 11,
     INVALID_CARTRIDGE_TYPE  = 12,
+    INVALID_HEADER          = 13,
+    CALIBRATION_FAILED      = 14,
 
     // PC tries op that the cart cannot handle
     INVALID_RAM_WRITE_SIZE  = 21,
     CARTRIDGE_HAS_NO_RAM    = 22,
     CARTRIDGE_HAS_NO_RTC    = 23,
-    INVALID_RTC_WRITE_SIZE  = 24
+    INVALID_RTC_WRITE_SIZE  = 24,
+    INVALID_COMPRESSED_DATA = 25,
+
+    // PC tries op that the board cannot handle
+    INVALID_ARGUMENTS       = 30,
+    UNSUPPORTED_BAUD_RATE   = 31
+};
+
+/*
+    Besides the ASCII lines typed into a terminal, the host can send binary requests:
+
+      REQUEST_MAGIC, opcode, request id (16 bit little endian), parameter length, parameters
+
+    The parameters are the text that would follow the command in ASCII mode, so both modes
+    end up in the same handlers. The answer starts with RESPONSE_MAGIC and the request id,
+    followed by exactly what the command sends in ASCII mode. Requests are handled in the
+    order they arrive, so the host can queue several back to back in the RX buffer as long
+    as none of them waits for more data from the host (write ram, baud, hashed or framed reads).
+
+    The host must not have more than UART_RING_SIZE bytes outstanding, the RX ring is all there
+    is to hold them. On the Basys3 the UART is polled and only drained while the CPU waits on
+    the UART or accesses the bus. While it computes (compressing a bank, hashing) nothing but the
+    16 byte FIFO of the UartLite takes data, so more than that must not arrive unasked.
+*/
+const uint8_t REQUEST_MAGIC = 0xb5;
+const uint8_t RESPONSE_MAGIC = 0xb6;
+
+enum opcode_t: uint8_t
+{
+    OP_HELP                 = 0x01,
+    OP_PARSE_HEADER         = 0x02,
+    OP_READ_ROM             = 0x03,
+    OP_READ_RAM             = 0x04,
+    OP_WRITE_RAM            = 0x05,
+    OP_READ_RANGE           = 0x06,
+    OP_BURST_ON             = 0x07,
+    OP_BURST_OFF            = 0x08,
+    OP_CALIBRATE            = 0x09,
+    OP_BAUD                 = 0x0a,
+
+    // Only available in builds with INSTRUMENTATION or CAPTURE
+    OP_STATS                = 0x40,
+    OP_CAPTURE_HEADER       = 0x41,
+    OP_CAPTURE_BANK         = 0x42
 };
 
+// Handlers get whatever followed the command and a space on the line (or an empty string).
+
 void cli_unknown();
-void cli_help();
-void cli_parse_header();
-void cli_read_rom();
-void cli_read_ram();
-void cli_write_ram();
+void cli_invalid_arguments();
+void cli_help(const char* arguments);
+void cli_parse_header(const char* arguments);
+void cli_read_rom(const char* arguments);
+void cli_read_ram(const char* arguments);
+void cli_read_range(const char* arguments);
+void cli_write_ram(const char* arguments);
+void cli_burst_on(const char* arguments);
+void cli_burst_off(const char* arguments);
+void cli_calibrate(const char* arguments);
+void cli_baud(const char* arguments);
+
+#ifdef INSTRUMENTATION
+void cli_stats(const char* arguments);
+#endif
+
+#ifdef CAPTURE
+void cli_capture_header(const char* arguments);
+void cli_capture_bank(const char* arguments);
+#endif
@@ -0,0 +1,142 @@
+#include "compression.h"
+
+#include <string.h>
+
+const uint16_t LITERAL_RUN_MAX = 128;
+const uint16_t MATCH_LENGTH_MIN = 3;
+const uint16_t MATCH_LENGTH_MAX = 130;
+
+const uint8_t MATCH_FLAG = 0x80;
+
+/*
+    NOTE: The match finder only remembers the last position of every 3 byte hash,
+          which is good enough for padding and repeated tile data and keeps the
+          table at 2 KiB so it also fits the BRAM of the MicroBlaze-V.
+*/
+const unsigned HASH_BITS = 10;
+const uint16_t NO_POSITION = 0xffff;
+
+static uint16_t last_positions[1 << HASH_BITS];
+
+static inline unsigned _hash(const uint8_t* bytes)
+{
+    uint32_t value = (uint32_t)bytes[0] << 16 | (uint32_t)bytes[1] << 8 | bytes[2];
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Emits the literal runs for source[start, end), returns false if they do not fit below limit.
+static bool _emit_literals(const uint8_t* source, uint16_t start, uint16_t end, uint8_t* destination, uint16_t& written, uint16_t limit)
+{
+    while (start < end)
+    {
+        uint16_t count = end - start < LITERAL_RUN_MAX ? end - start : LITERAL_RUN_MAX;
+
+        if (written + 1 + count >= limit)
+            return false;
+
+        destination[written++] = count - 1;
+        memcpy(&destination[written], &source[start], count);
+
+        written += count;
+        start += count;
+    }
+
+    return true;
+}
+
+uint16_t compress_bank(const uint8_t* source, uint16_t length, uint8_t* destination)
+{
+    memset(last_positions, 0xff, sizeof(last_positions));
+
+    uint16_t written = 0;
+    uint16_t literal_start = 0;
+    uint16_t position = 0;
+
+    while (position + MATCH_LENGTH_MIN <= length)
+    {
+        unsigned hash = _hash(&source[position]);
+        uint16_t candidate = last_positions[hash];
+        last_positions[hash] = position;
+
+        uint16_t match_length = 0;
+
+        if (candidate != NO_POSITION)
+        {
+            uint16_t match_length_max = length - position < MATCH_LENGTH_MAX ? length - position : MATCH_LENGTH_MAX;
+
+            while (match_length < match_length_max && source[candidate + match_length] == source[position + match_length])
+                match_length++;
+        }
+
+        if (match_length < MATCH_LENGTH_MIN)
+        {
+            position++;
+            continue;
+        }
+
+        if (!_emit_literals(source, literal_start, position, destination, written, length))
+            return 0;
+
+        if (written + 3 >= length)
+            return 0;
+
+        uint16_t distance = position - candidate;
+
+        destination[written++] = MATCH_FLAG | (match_length - MATCH_LENGTH_MIN);
+        destination[written++] = distance & 0xff;
+        destination[written++] = distance >> 8;
+
+        // Remember the positions inside the match as well, they are likely to repeat.
+        for (uint16_t i = 1; i < match_length && position + i + MATCH_LENGTH_MIN <= length; ++i)
+            last_positions[_hash(&source[position + i])] = position + i;
+
+        position += match_length;
+        literal_start = position;
+    }
+
+    if (!_emit_literals(source, literal_start, length, destination, written, length))
+        return 0;
+
+    return written;
+}
+
+bool decompress_bank(const uint8_t* source, uint16_t source_length, uint8_t* destination, uint16_t length)
+{
+    uint16_t read = 0;
+    uint16_t written = 0;
+
+    while (read < source_length)
+    {
+        uint8_t control = source[read++];
+
+        if (!(control & MATCH_FLAG))
+        {
+            uint16_t count = control + 1;
+
+            if (read + count > source_length || written + count > length)
+                return false;
+
+            memcpy(&destination[written], &source[read], count);
+
+            read += count;
+            written += count;
+            continue;
+        }
+
+        if (read + 2 > source_length)
+            return false;
+
+        uint16_t count = (control & ~MATCH_FLAG) + MATCH_LENGTH_MIN;
+        uint16_t distance = source[read] | source[read + 1] << 8;
+        read += 2;
+
+        if (distance == 0 || distance > written || written + count > length)
+            return false;
+
+        // Byte by byte on purpose, the match may overlap what it produces.
+        for (uint16_t i = 0; i < count; ++i, ++written)
+            destination[written] = destination[written - distance];
+    }
+
+    return written == length;
+}
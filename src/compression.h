@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    Small LZ codec for the banks sent over UART, python/compression.py implements the same format.
+    The stream is a sequence of tokens, each starting with a control byte:
+
+      0x00 - 0x7f   Literal run, (control + 1) bytes follow and are copied as they are.
+      0x80 - 0xff   Match, (control & 0x7f) + 3 bytes are copied from the output starting
+                    at the 16 bit little endian distance that follows (1 - 0xffff bytes back).
+
+    A match may overlap the bytes it produces, so a distance of 1 doubles as RLE
+    for the 0x00/0xff padding that is so common in ROMs and empty save RAM.
+    Offsets never leave the bank, so every bank can be decompressed on its own.
+*/
+enum bank_encoding: uint8_t
+{
+    BANK_RAW = 0,
+    BANK_COMPRESSED = 1
+};
+
+// Returns the compressed size or 0 if the bank does not get smaller.
+uint16_t compress_bank(const uint8_t* source, uint16_t length, uint8_t* destination);
+
+// Returns false if the data is corrupt or does not decompress to exactly length bytes.
+bool decompress_bank(const uint8_t* source, uint16_t source_length, uint8_t* destination, uint16_t length);
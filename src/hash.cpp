@@ -0,0 +1,176 @@
+#include "hash.h"
+
+#include <string.h>
+
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/*
+    NOTE: Slicing by 4 takes four bytes per table step but needs 4 KiB of tables, which the
+          PYNQ-Z2 has plenty of. The MicroBlaze-V keeps to a single table to save BRAM.
+*/
+#ifdef __riscv
+const unsigned CRC32_SLICES = 1;
+#else
+const unsigned CRC32_SLICES = 4;
+#endif
+
+// Reflected polynomial 0x04c11db7, the tables are built by the compiler.
+struct crc32_table
+{
+    uint32_t entries[CRC32_SLICES][256];
+
+    constexpr crc32_table() : entries()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for (unsigned bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+
+            entries[0][i] = crc;
+        }
+
+        for (unsigned slice = 1; slice < CRC32_SLICES; ++slice)
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+                entries[slice][i] = (entries[slice - 1][i] >> 8) ^ entries[0][entries[slice - 1][i] & 0xff];
+        }
+    }
+};
+
+static constexpr crc32_table CRC32_TABLE;
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, uint32_t length)
+{
+    const auto& table = CRC32_TABLE.entries;
+    crc = ~crc;
+
+#ifndef __riscv
+    for (; length >= 4; data += 4, length -= 4)
+    {
+        crc ^= (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+        crc = table[3][crc & 0xff] ^ table[2][(crc >> 8) & 0xff] ^ table[1][(crc >> 16) & 0xff] ^ table[0][crc >> 24];
+    }
+#endif
+
+    while (length--)
+        crc = table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+// NEON widens and accumulates 16 bytes per step where the BSP enables it, the rest is summed up plainly.
+uint32_t byte_sum(uint32_t sum, const uint8_t* data, uint32_t length)
+{
+#ifdef __ARM_NEON
+    uint32x4_t sums = vdupq_n_u32(0);
+
+    for (; length >= 16; data += 16, length -= 16)
+        sums = vpadalq_u16(sums, vpaddlq_u8(vld1q_u8(data)));
+
+    sum += vgetq_lane_u32(sums, 0) + vgetq_lane_u32(sums, 1) + vgetq_lane_u32(sums, 2) + vgetq_lane_u32(sums, 3);
+#endif
+
+    while (length--)
+        sum += *data++;
+
+    return sum;
+}
+
+static inline uint32_t _rotate_left(uint32_t value, unsigned bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// Processes one 64 byte block, the message schedule is kept as a ring of 16 words.
+static void _sha1_block(uint32_t state[5], const uint8_t* block)
+{
+    uint32_t w[16];
+
+    for (unsigned i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16
+             | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (unsigned i = 0; i < 80; ++i)
+    {
+        if (i >= 16)
+            w[i & 15] = _rotate_left(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+
+        uint32_t f, k;
+
+        if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+        else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+        else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+        else             { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+
+        uint32_t temp = _rotate_left(a, 5) + f + e + k + w[i & 15];
+        e = d;
+        d = c;
+        c = _rotate_left(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void sha1_init(sha1_context& context)
+{
+    context.state[0] = 0x67452301;
+    context.state[1] = 0xefcdab89;
+    context.state[2] = 0x98badcfe;
+    context.state[3] = 0x10325476;
+    context.state[4] = 0xc3d2e1f0;
+    context.length = 0;
+}
+
+void sha1_update(sha1_context& context, const uint8_t* data, uint32_t length)
+{
+    unsigned used = context.length & 63;
+    context.length += length;
+
+    // Top up a partial block first, whole blocks are hashed straight from the data.
+    if (used != 0)
+    {
+        unsigned count = 64 - used < length ? 64 - used : length;
+        memcpy(&context.block[used], data, count);
+
+        data += count;
+        length -= count;
+
+        if (used + count < 64)
+            return;
+
+        _sha1_block(context.state, context.block);
+    }
+
+    for (; length >= 64; data += 64, length -= 64)
+        _sha1_block(context.state, data);
+
+    memcpy(context.block, data, length);
+}
+
+void sha1_final(sha1_context& context, uint8_t digest[SHA1_DIGEST_SIZE])
+{
+    uint64_t bit_length = context.length * 8;
+
+    // Padding is a single 1 bit, zeros up to 56 mod 64 and the length in bits as big endian.
+    uint8_t padding[64 + 8] = { 0x80 };
+    unsigned padding_length = (context.length & 63) < 56 ? 56 - (context.length & 63) : 120 - (context.length & 63);
+
+    for (unsigned i = 0; i < 8; ++i)
+        padding[padding_length + i] = (uint8_t)(bit_length >> (56 - i * 8));
+
+    sha1_update(context, padding, padding_length + 8);
+
+    for (unsigned i = 0; i < SHA1_DIGEST_SIZE; ++i)
+        digest[i] = (uint8_t)(context.state[i / 4] >> (24 - (i % 4) * 8));
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    Digests of the data that is sent to the host, python/reader.py uses hashlib/zlib for the same.
+    Both are incremental so they can run over a transfer bank by bank.
+*/
+
+// CRC-32 as used by zlib/Ethernet, start with crc = 0 and feed the previous result back in.
+uint32_t crc32(uint32_t crc, const uint8_t* data, uint32_t length);
+
+// Adds up all bytes, e.g. for the global checksum of the cartridge header.
+uint32_t byte_sum(uint32_t sum, const uint8_t* data, uint32_t length);
+
+const uint32_t SHA1_DIGEST_SIZE = 20;
+
+struct sha1_context
+{
+    uint32_t state[5];
+    uint64_t length;
+    uint8_t block[64];
+};
+
+void sha1_init(sha1_context& context);
+void sha1_update(sha1_context& context, const uint8_t* data, uint32_t length);
+void sha1_final(sha1_context& context, uint8_t digest[SHA1_DIGEST_SIZE]);
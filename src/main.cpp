@@ -1,42 +1,131 @@
 #include "xparameters.h"
 
-#include "pmod.h"
+#include "bus.h"
 #include "cli_handlers.h"
 #include "misc.h"
 #include "print.h"
+#include "timing.h"
+#include "uart.h"
 
 #include <string.h>
 
 int main()
 {
-    if (init_pmod(XPAR_AXI_PMOD_GPIO_BASEADDR) != XST_SUCCESS)
-        die("PMOD GPIO Initialization failed.\r\n");
+    // Until this succeeded, the UART is polled and die() still works.
+    if (init_uart(STDOUT_BASEADDRESS) != XST_SUCCESS)
+        die("UART Initialization failed.\r\n");
 
-    const char* commands[] = {
-        "help", "parse header", "read rom", "read ram", "write ram",
+    select_default_timing_profile();
+
+    if (bus_init() != XST_SUCCESS)
+        die("Cartridge bus Initialization failed.\r\n");
+
+    struct command
+    {
+        const char* name;
+        opcode_t opcode;
+        void (* handler)(const char* arguments);
     };
 
-    void (* const handlers[])(void) = {
-        cli_help, cli_parse_header, cli_read_rom, cli_read_ram, cli_write_ram,
+    const command commands[] = {
+        { "help",           OP_HELP,            cli_help },
+        { "parse header",   OP_PARSE_HEADER,    cli_parse_header },
+        { "read rom",       OP_READ_ROM,        cli_read_rom },
+        { "read ram",       OP_READ_RAM,        cli_read_ram },
+        { "write ram",      OP_WRITE_RAM,       cli_write_ram },
+        { "read range",     OP_READ_RANGE,      cli_read_range },
+        { "burst on",       OP_BURST_ON,        cli_burst_on },
+        { "burst off",      OP_BURST_OFF,       cli_burst_off },
+        { "calibrate",      OP_CALIBRATE,       cli_calibrate },
+        { "baud",           OP_BAUD,            cli_baud },
+#ifdef INSTRUMENTATION
+        { "stats",          OP_STATS,           cli_stats },
+#endif
+#ifdef CAPTURE
+        { "capture header", OP_CAPTURE_HEADER,  cli_capture_header },
+        { "capture bank",   OP_CAPTURE_BANK,    cli_capture_bank },
+#endif
     };
 
-    char line_buffer[16];
+    // Long enough for "read range" (10), MAX_RANGE_REGIONS (8) regions of at most
+    // " ram 0xffff 0x4000 0x4000" (25) and the terminator. Longer lines are rejected.
+    char line_buffer[224];
 
     // TODO: Implemenet timeout mechanism of 3 seconds.
 
     while (true)
     {
+        char first = Uart_RecvByte(STDOUT_BASEADDRESS);
+
+        if ((uint8_t)first == REQUEST_MAGIC)
+        {
+            uint8_t request_header[4];
+            Uart_Recv(STDOUT_BASEADDRESS, request_header, sizeof(request_header));
+
+            uint8_t opcode = request_header[0];
+            uint8_t parameter_length = request_header[3];
+
+            // The parameters are always received in full so the next request stays in sync.
+            for (unsigned i = 0; i < parameter_length; ++i)
+            {
+                char parameter = Uart_RecvByte(STDOUT_BASEADDRESS);
+
+                if (i < sizeof(line_buffer) - 1)
+                    line_buffer[i] = parameter;
+            }
+
+            // The tag goes out first, the rest of the answer is the same as in ASCII mode.
+            uint8_t response_tag[3] = { RESPONSE_MAGIC, request_header[1], request_header[2] };
+            Uart_Send(STDOUT_BASEADDRESS, response_tag, sizeof(response_tag));
+
+            if (parameter_length >= sizeof(line_buffer))
+            {
+                cli_invalid_arguments();
+                continue;
+            }
+
+            line_buffer[parameter_length] = '\0';
+
+            bool valid_opcode = false;
+            for (uint8_t i = 0; i < arraysizeof(commands) && !valid_opcode; ++i)
+            {
+                if (commands[i].opcode != opcode) continue;
+
+                valid_opcode = true;
+                commands[i].handler(line_buffer);
+            }
+
+            if (!valid_opcode)
+                cli_unknown();
+
+            continue;
+        }
+
         /* NOTE: This function fills up the buffer and overwrites only the last character
-         if more arrive than the buffer can handle. It breaks upon receciving '\r'. */
-        uart_readline(line_buffer, sizeof(line_buffer));
+         if more arrive than the buffer can handle. It breaks upon receciving '\r'.
+         A truncated line is answered with an error instead of running what is left of it. */
+        if (!uart_readline(line_buffer, sizeof(line_buffer), first))
+        {
+            cli_invalid_arguments();
+            continue;
+        }
 
         bool valid_command = false;
         for (uint8_t i = 0; i < arraysizeof(commands); ++i)
-            if (!strcmp(line_buffer, commands[i]))
-            {
-                valid_command = true;
-                handlers[i]();
-            }
+        {
+            // Arguments are separated from the command by a space.
+            size_t command_length = strlen(commands[i].name);
+
+            if (strncmp(line_buffer, commands[i].name, command_length)) continue;
+
+            const char* arguments = &line_buffer[command_length];
+
+            if (*arguments == ' ') arguments++;
+            else if (*arguments != '\0') continue;
+
+            valid_command = true;
+            commands[i].handler(arguments);
+        }
 
         if (!valid_command && strcmp(line_buffer, ""))
             cli_unknown();
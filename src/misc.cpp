@@ -9,6 +9,7 @@
 [[noreturn]] void die(const char* message)
 {
     xil_printf("%s%s", message, "Critical Failure - Exiting Application!\r\n");
+    Uart_Flush();
     exit(XST_FAILURE);
 }
 
@@ -17,13 +18,16 @@ bool is_printable(const char letter)
     return (letter >= 0x20) && (letter <= 0x7e);
 }
 
-void uart_readline(char* buffer, uint8_t buffer_size)
+// The first character was already received by the caller to tell ASCII lines from binary requests.
+// Returns false if the line did not fit the buffer, the rest of it is received and discarded.
+bool uart_readline(char* buffer, uint8_t buffer_size, char first)
 {
     uint8_t num_received = 0;
+    bool overflow = false;
+    char received = first;
 
     while (true)
     {
-        char received = Uart_RecvByte(STDOUT_BASEADDRESS);
         num_received++;
 
         // Transform to lower case for strcmp
@@ -37,9 +41,16 @@ void uart_readline(char* buffer, uint8_t buffer_size)
 
         // Decrement buffer pointer to point to last element again.
         if (num_received == buffer_size)
+        {
             num_received--;
+            overflow = true;
+        }
+
+        received = Uart_RecvByte(STDOUT_BASEADDRESS);
     }
 
     // Overwrite the \r line break with null-terminator for strcmp.
     buffer[num_received - 1] = '\0';
+
+    return !overflow;
 }
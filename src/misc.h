@@ -6,4 +6,4 @@
 
 [[noreturn]] void die(const char* message);
 bool is_printable(const char letter);
-void uart_readline(char* buffer, uint8_t buffer_size);
+bool uart_readline(char* buffer, uint8_t buffer_size, char first);
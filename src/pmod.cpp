@@ -1,13 +1,12 @@
 #include "pmod.h"
 
-#include <sleep.h>
-
 PmodState pmod_state;
 XGpio pmod_gpio;
+uint16_t pmod_shadow;
 
-int init_pmod(uint32_t base_address)
+int init_pmod()
 {
-    int result = XGpio_Initialize(&pmod_gpio, base_address);
+    int result = XGpio_Initialize(&pmod_gpio, XPAR_AXI_PMOD_GPIO_BASEADDR);
     if (result != XST_SUCCESS) return result;
 
     // The GPIO IP Core starts in tri-state and needs its inputs/outputs configured.
@@ -49,23 +48,64 @@ void reset_pmod()
         .DATA_IN_SCLK = 0
     };
 
-    write_pmod();
+    // Do not trust the shadow here, the GPIO may have been written behind our back (e.g. on init).
+    pmod_shadow = ~pmod_state.value;
+    write_pmod(BusPhase::STROBE_HOLD);
 }
 
 /*
     NOTE: The PMOD IP core is clocked with 100 MHz but the cartridge
-    can handle at most 4.19 MHz (x2 in double speed mode) so we slow
-    it down to ~1MHz for now. Once the reading/writing routine
-    are done we can measure the IOs and sleep less to increase throughput.
+    can handle at most 4.19 MHz (x2 in double speed mode). Instead of
+    slowing every access down equally, each write waits as long as the
+    edge it generated requires according to the active timing profile.
 */
-void write_pmod()
+void write_pmod(BusPhase phase)
 {
-    XGpio_DiscreteWrite(&pmod_gpio, 1, pmod_state.value);
-    usleep(1);
+    // No edge was generated, so there is nothing to wait for.
+    if (pmod_gpio_write(pmod_state.value))
+        pmod_delay(phase);
 }
 
-void read_pmod()
+/*
+    Streams a precomputed sequence of shift clock edges to the GPIO. Only the bits
+    in mask are taken from the waveform, the others keep their current state.
+    Even entries are the falling (data setup) edges and odd entries the rising edges
+    of the shift clock so the delays alternate accordingly.
+*/
+void write_pmod_waveform(const uint16_t* waveform, unsigned length, uint16_t mask)
 {
-    pmod_state.value = (uint16_t)XGpio_DiscreteRead(&pmod_gpio, 1);
-    usleep(1);
+    const uint16_t base = pmod_state.value & ~mask;
+
+    for (unsigned i = 0; i < length; i += 2)
+    {
+        pmod_gpio_write(base | waveform[i]);
+        pmod_delay(BusPhase::SHIFT_CLOCK_LOW);
+
+        pmod_gpio_write(base | waveform[i + 1]);
+        pmod_delay(BusPhase::SHIFT_CLOCK_HIGH);
+    }
+
+    pmod_state.value = base | waveform[length - 1];
+}
+
+// Same as write_pmod_waveform but samples DATA_IN_SDATA before every clock pulse
+// and returns the sampled bits MSB first (at most 8 pulses are meaningful).
+uint8_t shift_pmod_waveform(const uint16_t* waveform, unsigned length, uint16_t mask)
+{
+    const uint16_t base = pmod_state.value & ~mask;
+    uint8_t byte = 0;
+
+    for (unsigned i = 0; i < length; i += 2)
+    {
+        byte = (byte << 1) | read_pmod().DATA_IN_SDATA;
+
+        pmod_gpio_write(base | waveform[i]);
+        pmod_delay(BusPhase::SHIFT_CLOCK_LOW);
+
+        pmod_gpio_write(base | waveform[i + 1]);
+        pmod_delay(BusPhase::SHIFT_CLOCK_HIGH);
+    }
+
+    pmod_state.value = base | waveform[length - 1];
+    return byte;
 }
@@ -2,6 +2,12 @@
 
 #include <cstdint>
 #include <xgpio.h>
+#include <xil_io.h>
+#include <xparameters.h>
+
+#include "timing.h"
+#include "stats.h"
+#include "capture.h"
 
 // DATA_OUT refers to FPGA->Cart
 // DATA_IN refers to Cart->FPGA
@@ -47,10 +53,57 @@ enum PmodSignals {
     DATA_IN_SCLK
 };
 
+/*
+    NOTE: The XGpio driver is only used for initialization. Going through
+    XGpio_DiscreteWrite/Read costs a call, asserts and the channel offset
+    calculation on every single edge, so the data register of channel 1
+    is accessed directly at its address known at compile time.
+*/
+constexpr UINTPTR PMOD_GPIO_DATA_ADDRESS = XPAR_AXI_PMOD_GPIO_BASEADDR + XGPIO_DATA_OFFSET;
+
 extern XGpio pmod_gpio;
 extern PmodState pmod_state;
 
-int init_pmod(uint32_t base_address);
+// Last value written to the GPIO, writes that would not change anything are dropped.
+extern uint16_t pmod_shadow;
+
+// Returns true if the value differed from the shadow and was actually written.
+inline bool pmod_gpio_write(uint16_t value)
+{
+    if (value == pmod_shadow)
+    {
+        STATS_ADD(gpio_writes_elided, 1);
+        return false;
+    }
+
+    Xil_Out32(PMOD_GPIO_DATA_ADDRESS, value);
+    pmod_shadow = value;
+
+    STATS_ADD(gpio_writes, 1);
+    CAPTURE_RECORD(CAPTURE_WRITE, value);
+
+    return true;
+}
+
+// Only DATA_IN_SDATA is an input, the other bits mirror the outputs.
+inline PmodState read_pmod()
+{
+    STATS_ADD(gpio_reads, 1);
+
+    PmodState state = { .value = (uint16_t)Xil_In32(PMOD_GPIO_DATA_ADDRESS) };
+    CAPTURE_RECORD(CAPTURE_READ, state.value);
+
+    return state;
+}
+
+inline void pmod_delay(BusPhase phase)
+{
+    STATS_ADD(delay_ticks, bus_delay_ticks[phase]);
+    bus_delay(phase);
+}
+
+int init_pmod();
 void reset_pmod();
-void write_pmod();
-void read_pmod();
+void write_pmod(BusPhase phase);
+void write_pmod_waveform(const uint16_t* waveform, unsigned length, uint16_t mask);
+uint8_t shift_pmod_waveform(const uint16_t* waveform, unsigned length, uint16_t mask);
@@ -0,0 +1,8 @@
+#include "stats.h"
+
+#ifdef INSTRUMENTATION
+
+Stats stats;
+uint32_t stats_phase_start[NUM_STATS_PHASES];
+
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+#include "timing.h"
+
+/*
+    Hot path instrumentation. Define INSTRUMENTATION in the application's
+    UserConfig.cmake (like UARTLITE) to enable it, otherwise all STATS_*
+    macros expand to nothing and production builds pay nothing for them.
+*/
+enum StatsPhase: uint8_t
+{
+    PHASE_HEADER_READ,
+    PHASE_BANK_SWITCH,      // Register writes, also contained in bank read/write
+    PHASE_BANK_READ,
+    PHASE_BANK_WRITE,
+    PHASE_UART_DRAIN,       // Waiting for queued bytes, the overlapped part is hidden in bank read
+    PHASE_COMPRESSION,      // Compressing and decompressing banks of compressed transfers
+    PHASE_HASH,             // Bank digests of hashed transfers
+
+    NUM_STATS_PHASES
+};
+
+struct Stats
+{
+    uint32_t gpio_writes;
+    uint32_t gpio_writes_elided;
+    uint32_t gpio_reads;
+    uint64_t delay_ticks;
+    uint32_t register_writes;
+    uint32_t register_writes_elided;
+    uint32_t uart_bytes_sent;
+    uint32_t uart_bytes_received;
+    uint64_t uart_stall_ticks;
+
+    uint64_t phase_ticks[NUM_STATS_PHASES];
+    uint32_t phase_count[NUM_STATS_PHASES];
+};
+
+#ifdef INSTRUMENTATION
+
+extern Stats stats;
+extern uint32_t stats_phase_start[NUM_STATS_PHASES];
+
+#define STATS_ADD(counter, amount) (stats.counter += (amount))
+
+#define STATS_PHASE_BEGIN(phase) (stats_phase_start[StatsPhase::phase] = get_timer_ticks())
+
+#define STATS_PHASE_END(phase) do { \
+        stats.phase_ticks[StatsPhase::phase] += get_timer_ticks() - stats_phase_start[StatsPhase::phase]; \
+        stats.phase_count[StatsPhase::phase]++; \
+    } while (0)
+
+#else
+
+#define STATS_ADD(counter, amount) ((void)0)
+#define STATS_PHASE_BEGIN(phase) ((void)0)
+#define STATS_PHASE_END(phase) ((void)0)
+
+#endif
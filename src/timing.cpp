@@ -0,0 +1,182 @@
+#include "timing.h"
+
+#include "cartridge.h"
+
+#include <string.h>
+
+#ifdef __riscv
+#include <xparameters.h>
+#else
+#include <xil_io.h>
+#include <xtime_l.h>
+#endif
+
+/*
+    NOTE: The delays are the minimum time between a GPIO write and the next one.
+    The 74HC595/165 are fine with a few dozen nanoseconds at 3.3V, the cartridge
+    needs a lot longer to put the data on the bus after RDn/CSn/address changes
+    which is why STROBE_SETUP varies with the cartridge type.
+
+    The MicroBlaze-V on the Basys3 runs at 100 MHz and a single AXI GPIO write
+    already takes longer than the shift registers need, only the cartridge
+    access time has to be waited for. The ARM on the PYNQ-Z2 posts its writes
+    on the GP port and can produce edges much faster than that.
+
+    The conservative profile matches the former blanket usleep(1) and is used
+    whenever the cartridge type is not known yet (e.g. reading the header).
+*/
+enum timing_profile_index: uint8_t
+{
+    PROFILE_CONSERVATIVE,
+    PROFILE_DMG,
+    PROFILE_MBC3,
+    PROFILE_MBC5,
+};
+
+#ifdef __riscv
+static const TimingProfile timing_profiles[] = {
+    //                                 SCLK_L SCLK_H  RCLK   PLn  SETUP  HOLD
+    { "Basys3 Conservative",          { 1000,  1000,  1000,  1000,  1000,  1000 } },
+    { "Basys3 DMG (ROM/MBC1/MBC2)",   {    0,     0,     0,     0,   150,     0 } },
+    { "Basys3 MBC3",                  {    0,     0,     0,     0,   100,     0 } },
+    { "Basys3 MBC5",                  {    0,     0,     0,     0,    50,     0 } },
+};
+#else
+static const TimingProfile timing_profiles[] = {
+    //                                 SCLK_L SCLK_H  RCLK   PLn  SETUP  HOLD
+    { "PYNQ-Z2 Conservative",         { 1000,  1000,  1000,  1000,  1000,  1000 } },
+    { "PYNQ-Z2 DMG (ROM/MBC1/MBC2)",  {   30,    30,    30,    30,   250,    30 } },
+    { "PYNQ-Z2 MBC3",                 {   30,    30,    30,    30,   200,    30 } },
+    { "PYNQ-Z2 MBC5",                 {   30,    30,    30,    30,   150,    30 } },
+};
+#endif
+
+uint32_t bus_delay_ticks[NUM_BUS_PHASES];
+static const TimingProfile* active_profile = nullptr;
+static uint8_t active_scale = 100;
+
+static bool calibrated = false;
+static uint8_t calibrated_scale = 100;
+static cartridge_header calibrated_header;
+
+static void _apply_timing_profile(const TimingProfile* profile, uint8_t scale = 100)
+{
+    active_profile = profile;
+    active_scale = scale;
+
+    for (unsigned phase = 0; phase < NUM_BUS_PHASES; ++phase)
+        bus_delay_ticks[phase] = ns_to_ticks(profile->delay_ns[phase] * scale / 100);
+}
+
+void select_default_timing_profile()
+{
+    _apply_timing_profile(&timing_profiles[timing_profile_index::PROFILE_CONSERVATIVE]);
+}
+
+void select_timing_profile(const cartridge_header* header)
+{
+    uint8_t scale = 100;
+
+    if (calibrated && !memcmp(header, &calibrated_header, sizeof(cartridge_header)))
+        scale = calibrated_scale;
+
+    select_timing_profile(header, scale);
+}
+
+void select_timing_profile(const cartridge_header* header, uint8_t scale)
+{
+    switch (header->cartridge_type)
+    {
+        case cartridge_type::ROM:
+        case cartridge_type::MBC1:
+        case cartridge_type::MBC1_RAM:
+        case cartridge_type::MBC1_RAM_BATTERY:
+        case cartridge_type::MBC2:
+        case cartridge_type::MBC2_BATTERY:
+            _apply_timing_profile(&timing_profiles[timing_profile_index::PROFILE_DMG], scale);
+            break;
+
+        case cartridge_type::MBC3:
+        case cartridge_type::MBC3_RAM:
+        case cartridge_type::MBC3_RAM_BATTERY:
+        case cartridge_type::MBC3_RTC_BATTERY:
+        case cartridge_type::MBC3_RTC_RAM_BATTERY:
+            _apply_timing_profile(&timing_profiles[timing_profile_index::PROFILE_MBC3], scale);
+            break;
+
+        case cartridge_type::MBC5:
+        case cartridge_type::MBC5_RAM:
+        case cartridge_type::MBC5_RAM_BATTERY:
+        case cartridge_type::MBC5_RUMBLE:
+        case cartridge_type::MBC5_RUMBLE_RAM:
+        case cartridge_type::MBC5_RUMBLE_RAM_BATTERY:
+            _apply_timing_profile(&timing_profiles[timing_profile_index::PROFILE_MBC5], scale);
+            break;
+
+        // Unknown or unsupported mappers stay on the safe side.
+        default:
+            select_default_timing_profile();
+            break;
+    }
+}
+
+const TimingProfile* get_timing_profile()
+{
+    return active_profile;
+}
+
+uint8_t get_timing_scale()
+{
+    return active_scale;
+}
+
+void set_timing_calibration(const cartridge_header* header, uint8_t scale)
+{
+    memcpy(&calibrated_header, header, sizeof(cartridge_header));
+    calibrated_scale = scale;
+    calibrated = true;
+}
+
+void clear_timing_calibration()
+{
+    calibrated = false;
+}
+
+/*
+    NOTE: The ARM uses the lower half of the free running global timer (CPU clock / 2)
+    which is plenty for delays and wraps harmlessly with unsigned subtraction.
+    The MicroBlaze-V has no timer in the block design so the cycle counter is used,
+    which requires the core to be configured with its counters enabled.
+*/
+uint32_t get_timer_ticks()
+{
+#ifdef __riscv
+    uint32_t cycles;
+    asm volatile ("csrr %0, mcycle" : "=r"(cycles));
+    return cycles;
+#else
+    return Xil_In32(GLOBAL_TMR_BASEADDR + GTIMER_COUNTER_LOWER_OFFSET);
+#endif
+}
+
+#ifdef __riscv
+const uint32_t TICKS_PER_US = XPAR_CPU_CORE_CLOCK_FREQ_HZ / 1000000;
+#else
+const uint32_t TICKS_PER_US = COUNTS_PER_SECOND / 1000000;
+#endif
+
+uint32_t ns_to_ticks(uint32_t ns)
+{
+    // Round up, a delay that is too short is worse than one that is too long.
+    return (ns * TICKS_PER_US + 999) / 1000;
+}
+
+uint32_t ticks_to_us(uint64_t ticks)
+{
+    return (uint32_t)(ticks / TICKS_PER_US);
+}
+
+uint32_t us_to_ticks(uint32_t us)
+{
+    return us * TICKS_PER_US;
+}
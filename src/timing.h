@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+// Every write to the PMOD GPIO is followed by a delay that depends on which
+// edge was just generated. The phases are named after the edges of the
+// 74HC595 (address and data out) and 74HC165 (data in) shift registers
+// and the cartridge strobes.
+enum BusPhase: uint8_t
+{
+    SHIFT_CLOCK_LOW,    // SCLK low + SDATA setup of the shift registers
+    SHIFT_CLOCK_HIGH,   // SCLK high pulse width of the shift registers
+    REGISTER_LATCH,     // RCLK pulse of the storage registers
+    PARALLEL_LOAD,      // PLn low pulse of the 74HC165
+    STROBE_SETUP,       // RDn/WRn/CSn asserted until the cartridge drives/latches data
+    STROBE_HOLD,        // RDn/WRn/CSn released until the next bus cycle may start
+
+    NUM_BUS_PHASES
+};
+
+// Delays are specified in nanoseconds and converted into busy-wait ticks
+// whenever a profile is selected so the hot path never has to divide.
+struct TimingProfile
+{
+    const char* name;
+    uint16_t delay_ns[NUM_BUS_PHASES];
+};
+
+extern uint32_t bus_delay_ticks[NUM_BUS_PHASES];
+
+struct cartridge_header;
+
+/*
+    The cartridge profiles can be scaled down (in percent) by the calibrate command.
+    The calibrated scale is remembered together with the header of the calibrated
+    cartridge and only applied as long as that very cartridge is inserted.
+
+    NOTE: Calibration only verifies reads, writes always use the unscaled profile
+          (see cli_write_ram) since shortened WRn/CSn strobes are not checked.
+*/
+void select_default_timing_profile();
+void select_timing_profile(const cartridge_header* header);
+void select_timing_profile(const cartridge_header* header, uint8_t scale);
+const TimingProfile* get_timing_profile();
+uint8_t get_timing_scale();
+
+void set_timing_calibration(const cartridge_header* header, uint8_t scale);
+void clear_timing_calibration();
+
+uint32_t get_timer_ticks();
+uint32_t ns_to_ticks(uint32_t ns);
+uint32_t ticks_to_us(uint64_t ticks);
+uint32_t us_to_ticks(uint32_t us);
+
+inline void bus_delay(BusPhase phase)
+{
+    uint32_t ticks = bus_delay_ticks[phase];
+    if (ticks == 0) return;
+
+    uint32_t start = get_timer_ticks();
+    while (get_timer_ticks() - start < ticks);
+}
@@ -1,19 +1,433 @@
 #include "uart.h"
 
-void Uart_SendByte(UINTPTR BaseAddress, u8 Data)
+#include "stats.h"
+
+#ifndef UARTLITE
+#include <xil_exception.h>
+#include <xinterrupt_wrap.h>
+#endif
+
+/*
+    NOTE: The indices run freely and are only masked on access, so head == tail is empty
+          and head - tail == UART_RING_SIZE is full. Each index is only ever written by one
+          side (main loop or interrupt), which is why no locking is needed for the rings.
+*/
+const u32 UART_RING_MASK = UART_RING_SIZE - 1;
+
+static_assert((UART_RING_SIZE & UART_RING_MASK) == 0, "UART_RING_SIZE must be a power of two.");
+
+struct uart_ring
 {
+    u8 data[UART_RING_SIZE];
+    volatile u32 head;
+    volatile u32 tail;
+};
+
+static uart_ring tx_ring;
+static uart_ring rx_ring;
+
+static UINTPTR uart_base_address = STDOUT_BASEADDRESS;
+
+static const u8* volatile uart_queue_data;
+static volatile u32 uart_queue_length = 0;
+
+static u8* volatile uart_rx_queue_data;
+static volatile u32 uart_rx_queue_length = 0;
+
+bool uart_polled = true;
+volatile bool uart_tx_pending = false;
+
+static inline bool _ring_empty(const uart_ring& ring)
+{
+    return ring.head == ring.tail;
+}
+
+static inline bool _ring_full(const uart_ring& ring)
+{
+    return ring.head - ring.tail == UART_RING_SIZE;
+}
+
 #ifdef UARTLITE
-    XUartLite_SendByte(BaseAddress, Data);
+static inline bool _receive_ready()   { return !XUartLite_IsReceiveEmpty(uart_base_address); }
+static inline bool _transmit_full()   { return XUartLite_IsTransmitFull(uart_base_address); }
+static inline u8 _read_fifo()         { return XUartLite_ReadReg(uart_base_address, XUL_RX_FIFO_OFFSET); }
+static inline void _write_fifo(u8 b)  { XUartLite_WriteReg(uart_base_address, XUL_TX_FIFO_OFFSET, b); }
 #else
-    XUartPs_SendByte(BaseAddress, Data);
+static inline bool _receive_ready()   { return XUartPs_IsReceiveData(uart_base_address); }
+static inline bool _transmit_full()   { return XUartPs_IsTransmitFull(uart_base_address); }
+static inline u8 _read_fifo()         { return XUartPs_ReadReg(uart_base_address, XUARTPS_FIFO_OFFSET); }
+static inline void _write_fifo(u8 b)  { XUartPs_WriteReg(uart_base_address, XUARTPS_FIFO_OFFSET, b); }
 #endif
+
+// Moves as much as the FIFOs allow between them and the rings.
+void Uart_Service()
+{
+    // A queued receive takes everything until it is complete, the ring only what arrives after it.
+    while ((uart_rx_queue_length != 0 || !_ring_full(rx_ring)) && _receive_ready())
+    {
+        if (uart_rx_queue_length != 0)
+        {
+            *uart_rx_queue_data = _read_fifo();
+            uart_rx_queue_data = uart_rx_queue_data + 1;
+            uart_rx_queue_length = uart_rx_queue_length - 1;
+        }
+        else
+        {
+            rx_ring.data[rx_ring.head & UART_RING_MASK] = _read_fifo();
+            rx_ring.head = rx_ring.head + 1;
+        }
+    }
+
+    // Checked first, so an idle pump does not have to read the TX status as well.
+    while ((!_ring_empty(tx_ring) || uart_queue_length != 0) && !_transmit_full())
+    {
+        if (!_ring_empty(tx_ring))
+        {
+            _write_fifo(tx_ring.data[tx_ring.tail & UART_RING_MASK]);
+            tx_ring.tail = tx_ring.tail + 1;
+        }
+        else
+        {
+            _write_fifo(*uart_queue_data);
+            uart_queue_data = uart_queue_data + 1;
+            uart_queue_length = uart_queue_length - 1;
+        }
+    }
+
+    uart_tx_pending = !_ring_empty(tx_ring) || uart_queue_length != 0;
+
+#ifndef UARTLITE
+    if (uart_polled) return;
+
+    // Only ask for the TX interrupt while there is something left to send and
+    // hold off the RX interrupt while the ring cannot take any more.
+    XUartPs_WriteReg(
+        uart_base_address, uart_tx_pending ? XUARTPS_IER_OFFSET : XUARTPS_IDR_OFFSET,
+        XUARTPS_IXR_TXEMPTY
+    );
+    XUartPs_WriteReg(
+        uart_base_address, _ring_full(rx_ring) ? XUARTPS_IDR_OFFSET : XUARTPS_IER_OFFSET,
+        XUARTPS_IXR_RXOVR | XUARTPS_IXR_TOUT
+    );
+#endif
+}
+
+#ifndef UARTLITE
+static void _uart_interrupt_handler(void*)
+{
+    u32 status = XUartPs_ReadReg(uart_base_address, XUARTPS_ISR_OFFSET);
+    XUartPs_WriteReg(uart_base_address, XUARTPS_ISR_OFFSET, status);
+
+    Uart_Service();
 }
+#endif
 
-u8 Uart_RecvByte(UINTPTR BaseAddress)
+// Lets the service routine pick up what the main loop just put into or took out of the rings.
+static void _uart_kick()
 {
+    if (uart_polled)
+    {
+        Uart_Service();
+        return;
+    }
+
+#ifndef UARTLITE
+    Xil_ExceptionDisable();
+    Uart_Service();
+    Xil_ExceptionEnable();
+#endif
+}
+
+// Busy-waits for the service routine, which has to be called by hand without interrupts.
+static inline void _uart_wait()
+{
+    if (uart_polled)
+        Uart_Service();
+}
+
 #ifdef UARTLITE
-    return XUartLite_RecvByte(BaseAddress);
+static u32 uart_default_baud_rate = XPAR_XUARTLITE_0_BAUDRATE;
 #else
-    return XUartPs_RecvByte(BaseAddress);
+static u32 uart_default_baud_rate = 115200;
+
+// Mismatch between both ends that is still received reliably.
+const u32 MAX_BAUD_RATE_ERROR_PERCENT = 2;
+
+struct baud_divisors
+{
+    u32 clock_divisor;
+    u32 baud_divisor;
+};
+
+// The PS UART samples every bit BDIV + 1 times (BDIV >= 4) with a clock of UART_REF_CLK / CD.
+static bool _calculate_baud_divisors(u32 baud_rate, baud_divisors* divisors)
+{
+    if (baud_rate == 0 || baud_rate > XPAR_XUARTPS_0_CLOCK_FREQ / 5) return false;
+
+    u32 best_error = 0xffffffff;
+
+    for (u32 baud_divisor = 4; baud_divisor < 255; ++baud_divisor)
+    {
+        u32 clock_divisor = (XPAR_XUARTPS_0_CLOCK_FREQ + baud_rate * (baud_divisor + 1) / 2) / (baud_rate * (baud_divisor + 1));
+        if (clock_divisor == 0 || clock_divisor > 0xffff) continue;
+
+        u32 actual_rate = XPAR_XUARTPS_0_CLOCK_FREQ / (clock_divisor * (baud_divisor + 1));
+        u32 error = actual_rate > baud_rate ? actual_rate - baud_rate : baud_rate - actual_rate;
+
+        if (error < best_error)
+        {
+            best_error = error;
+            divisors->clock_divisor = clock_divisor;
+            divisors->baud_divisor = baud_divisor;
+        }
+    }
+
+    return best_error != 0xffffffff && best_error * 100 <= baud_rate * MAX_BAUD_RATE_ERROR_PERCENT;
+}
+#endif
+
+int init_uart(UINTPTR BaseAddress)
+{
+    uart_base_address = BaseAddress;
+
+#ifdef UARTLITE
+    // The Basys3 block design has no interrupt controller, stay polled.
+    return XST_SUCCESS;
+#else
+    // Whatever the BSP set up is the rate the host expects after power up.
+    u32 clock_divisor = XUartPs_ReadReg(BaseAddress, XUARTPS_BAUDGEN_OFFSET);
+    u32 baud_divisor = XUartPs_ReadReg(BaseAddress, XUARTPS_BAUDDIV_OFFSET);
+    if (clock_divisor != 0)
+        uart_default_baud_rate = XPAR_XUARTPS_0_CLOCK_FREQ / (clock_divisor * (baud_divisor + 1));
+
+    // Interrupt once the RX FIFO is half full or nothing arrived for 4 * 4 bit periods,
+    // so short command lines are not stuck in the FIFO.
+    XUartPs_WriteReg(BaseAddress, XUARTPS_RXWM_OFFSET, 32);
+    XUartPs_WriteReg(BaseAddress, XUARTPS_RXTOUT_OFFSET, 4);
+
+    XUartPs_WriteReg(BaseAddress, XUARTPS_IDR_OFFSET, XUARTPS_IXR_MASK);
+    XUartPs_WriteReg(BaseAddress, XUARTPS_ISR_OFFSET, XUARTPS_IXR_MASK);
+
+    int result = XSetupInterruptSystem(
+        nullptr, (void*)_uart_interrupt_handler,
+        XPAR_XUARTPS_0_INTERRUPTS, XPAR_XUARTPS_0_INTERRUPT_PARENT,
+        XINTERRUPT_DEFAULT_PRIORITY
+    );
+    if (result != XST_SUCCESS) return result;
+
+    uart_polled = false;
+    _uart_kick();
+
+    return XST_SUCCESS;
 #endif
 }
+
+void Uart_SendByte(UINTPTR, u8 Data)
+{
+    // Queued bytes have to go out first.
+    if (uart_queue_length != 0)
+        Uart_Flush();
+
+#ifdef INSTRUMENTATION
+    uint32_t start = get_timer_ticks();
+#endif
+
+    while (_ring_full(tx_ring))
+        _uart_wait();
+
+    STATS_ADD(uart_stall_ticks, get_timer_ticks() - start);
+    STATS_ADD(uart_bytes_sent, 1);
+
+    tx_ring.data[tx_ring.head & UART_RING_MASK] = Data;
+    tx_ring.head = tx_ring.head + 1;
+
+    _uart_kick();
+}
+
+u8 Uart_RecvByte(UINTPTR)
+{
+    // Whatever is in the ring arrived after the queued block.
+    if (uart_rx_queue_length != 0)
+        Uart_WaitRecv();
+
+    while (_ring_empty(rx_ring))
+        _uart_wait();
+
+    STATS_ADD(uart_bytes_received, 1);
+
+    u8 data = rx_ring.data[rx_ring.tail & UART_RING_MASK];
+    rx_ring.tail = rx_ring.tail + 1;
+
+    // The ring was full before, so the RX interrupt has been turned off.
+    if (rx_ring.head - rx_ring.tail == UART_RING_SIZE - 1)
+        _uart_kick();
+
+    return data;
+}
+
+void Uart_Send(UINTPTR, const u8* Data, u32 Length)
+{
+    if (uart_queue_length != 0)
+        Uart_Flush();
+
+    STATS_ADD(uart_bytes_sent, Length);
+
+    while (Length != 0)
+    {
+#ifdef INSTRUMENTATION
+        uint32_t start = get_timer_ticks();
+#endif
+
+        while (_ring_full(tx_ring))
+            _uart_wait();
+
+        STATS_ADD(uart_stall_ticks, get_timer_ticks() - start);
+
+        // Copy as much as fits and let the FIFO take its share right away.
+        u32 space = UART_RING_SIZE - (tx_ring.head - tx_ring.tail);
+        u32 count = Length < space ? Length : space;
+
+        for (u32 i = 0; i < count; ++i)
+            tx_ring.data[(tx_ring.head + i) & UART_RING_MASK] = Data[i];
+
+        tx_ring.head = tx_ring.head + count;
+        Data += count;
+        Length -= count;
+
+        _uart_kick();
+    }
+}
+
+void Uart_Recv(UINTPTR BaseAddress, u8* Data, u32 Length)
+{
+    for (u32 i = 0; i < Length; ++i)
+        Data[i] = Uart_RecvByte(BaseAddress);
+}
+
+void Uart_QueueBytes(UINTPTR, const u8* Data, u32 Length)
+{
+    // Only one block can be queued at a time.
+    Uart_Flush();
+
+    STATS_ADD(uart_bytes_sent, Length);
+
+    uart_queue_data = Data;
+    uart_queue_length = Length;
+
+    _uart_kick();
+}
+
+void Uart_QueueRecv(UINTPTR, u8* Data, u32 Length)
+{
+    // Only one block can be queued at a time.
+    Uart_WaitRecv();
+
+    STATS_ADD(uart_bytes_received, Length);
+
+    // The interrupt must not put anything into the ring until the queue took over from it.
+#ifndef UARTLITE
+    if (!uart_polled)
+        Xil_ExceptionDisable();
+#endif
+
+    for (; Length != 0 && !_ring_empty(rx_ring); --Length)
+    {
+        *Data++ = rx_ring.data[rx_ring.tail & UART_RING_MASK];
+        rx_ring.tail = rx_ring.tail + 1;
+    }
+
+    uart_rx_queue_data = Data;
+    uart_rx_queue_length = Length;
+
+    // Also turns the RX interrupt back on in case the ring was full.
+    Uart_Service();
+
+#ifndef UARTLITE
+    if (!uart_polled)
+        Xil_ExceptionEnable();
+#endif
+}
+
+void Uart_WaitRecv()
+{
+    while (uart_rx_queue_length != 0)
+        _uart_wait();
+}
+
+// Waits until the rings and the queue are handed to the FIFO.
+void Uart_Flush()
+{
+#ifdef INSTRUMENTATION
+    uint32_t start = get_timer_ticks();
+#endif
+
+    while (!_ring_empty(tx_ring) || uart_queue_length != 0)
+        _uart_wait();
+
+    STATS_ADD(uart_stall_ticks, get_timer_ticks() - start);
+}
+
+// xil_printf() ends up here, so the text output is buffered as well (overrides the BSP's outbyte).
+extern "C" void outbyte(char c)
+{
+    Uart_SendByte(uart_base_address, c);
+}
+
+// Returns false if nothing was received within the timeout.
+bool Uart_RecvByteTimeout(UINTPTR BaseAddress, u8* Data, u32 TimeoutUs)
+{
+    uint32_t start = get_timer_ticks();
+    uint32_t timeout = us_to_ticks(TimeoutUs);
+
+    while (_ring_empty(rx_ring))
+    {
+        if (get_timer_ticks() - start >= timeout)
+            return false;
+
+        _uart_wait();
+    }
+
+    *Data = Uart_RecvByte(BaseAddress);
+    return true;
+}
+
+bool Uart_IsBaudRateSupported(u32 BaudRate)
+{
+#ifdef UARTLITE
+    return BaudRate == XPAR_XUARTLITE_0_BAUDRATE;
+#else
+    baud_divisors divisors;
+    return _calculate_baud_divisors(BaudRate, &divisors);
+#endif
+}
+
+// Waits for everything to be sent and switches, whatever is in flight on the RX side is lost.
+void Uart_SetBaudRate(UINTPTR BaseAddress, u32 BaudRate)
+{
+#ifdef UARTLITE
+    (void)BaseAddress;
+    (void)BaudRate;
+#else
+    baud_divisors divisors;
+    if (!_calculate_baud_divisors(BaudRate, &divisors)) return;
+
+    Uart_Flush();
+
+    // The FIFO being empty is not enough, the last byte has to leave the shift register too.
+    while ((XUartPs_ReadReg(BaseAddress, XUARTPS_SR_OFFSET) & (XUARTPS_SR_TXEMPTY | XUARTPS_SR_TACTIVE)) != XUARTPS_SR_TXEMPTY);
+
+    // The divisors may only be changed while the receiver and transmitter are disabled.
+    XUartPs_WriteReg(BaseAddress, XUARTPS_CR_OFFSET, XUARTPS_CR_RX_DIS | XUARTPS_CR_TX_DIS);
+
+    XUartPs_WriteReg(BaseAddress, XUARTPS_BAUDGEN_OFFSET, divisors.clock_divisor);
+    XUartPs_WriteReg(BaseAddress, XUARTPS_BAUDDIV_OFFSET, divisors.baud_divisor);
+
+    XUartPs_WriteReg(BaseAddress, XUARTPS_CR_OFFSET, XUARTPS_CR_TXRST | XUARTPS_CR_RXRST);
+    XUartPs_WriteReg(BaseAddress, XUARTPS_CR_OFFSET, XUARTPS_CR_RX_EN | XUARTPS_CR_TX_EN | XUARTPS_CR_STOPBRK);
+#endif
+}
+
+u32 Uart_GetDefaultBaudRate()
+{
+    return uart_default_baud_rate;
+}
@@ -6,5 +6,65 @@
 #include <xuartps.h>
 #endif
 
+/*
+    Buffered driver for the UART the host is connected to. Both directions go through
+    ring buffers which are moved to and from the hardware FIFOs in blocks by Uart_Service().
+
+    On the PYNQ-Z2 Uart_Service() runs from the PS UART interrupt (RX trigger level/timeout
+    and TX empty). The Basys3 has no interrupt controller in the block design, so there it
+    is polled whenever the CPU waits on the UART and by the bus between bytes (Uart_Pump).
+
+    There is only one buffered UART. The BaseAddress parameters are kept to look like the
+    Xilinx drivers and have to match the one passed to init_uart().
+*/
+int init_uart(UINTPTR BaseAddress);
+
+// Size of both rings. The RX ring is what the host can send ahead while the CPU is busy elsewhere.
+const u32 UART_RING_SIZE = 1024;
+
 void Uart_SendByte(UINTPTR BaseAddress, u8 Data);
 u8 Uart_RecvByte(UINTPTR BaseAddress);
+void Uart_Send(UINTPTR BaseAddress, const u8* Data, u32 Length);
+void Uart_Recv(UINTPTR BaseAddress, u8* Data, u32 Length);
+
+/*
+    Transmit queue to overlap UART transmission with cartridge access.
+    Uart_QueueBytes() does not copy the data, it is sent straight from the passed buffer
+    once everything before it went out. The data MUST NOT be modified until Uart_Flush()
+    returned or the next block was queued.
+*/
+void Uart_QueueBytes(UINTPTR BaseAddress, const u8* Data, u32 Length);
+void Uart_Flush();
+
+/*
+    Receive queue, the same for the other direction. Uart_QueueRecv() hands the buffer to the
+    service routine, which stores everything from the RX ring and everything arriving after it
+    right there until Length bytes came in. Meanwhile the CPU is free to do something else,
+    Uart_WaitRecv() returns once the block is complete. The data MUST NOT be used before that.
+*/
+void Uart_QueueRecv(UINTPTR BaseAddress, u8* Data, u32 Length);
+void Uart_WaitRecv();
+
+void Uart_Service();
+
+bool Uart_RecvByteTimeout(UINTPTR BaseAddress, u8* Data, u32 TimeoutUs);
+
+/*
+    The PS UART derives its baud rate from the UART reference clock and can be switched
+    at runtime. The baud rate of the AXI UartLite is fixed when the bitstream is built,
+    so on the Basys3 only that very rate is accepted.
+*/
+bool Uart_IsBaudRateSupported(u32 BaudRate);
+void Uart_SetBaudRate(UINTPTR BaseAddress, u32 BaudRate);
+u32 Uart_GetDefaultBaudRate();
+
+extern bool uart_polled;
+extern volatile bool uart_tx_pending;
+
+// Drains the RX FIFO into the ring on every call, so whatever the host sends ahead is never lost
+// while the polled CPU is busy on the bus. With nothing to send that is a single status read.
+inline void Uart_Pump()
+{
+    if (uart_polled)
+        Uart_Service();
+}